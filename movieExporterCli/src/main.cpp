@@ -0,0 +1,708 @@
+/*
+ *  main.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "MovieExporter.h"
+#include "MovieReader.h"
+
+extern "C"
+{
+	#include <imgutils.h>
+	#include <pixdesc.h>
+}
+
+// encodes frames made by other tools with the same pipeline as the addon, and times it:
+//   movieExporterCli -i frames/img_%05d.png -o out.mp4 -r 30
+//   render | movieExporterCli -i - -s 1920x1080 -o out.mov -c mpeg2video
+//   movieExporterCli -i in.mov -o out.mp4 -S 1280x720 -b 2000000
+
+using namespace itg;
+
+namespace
+{
+	struct Options
+	{
+		Options() :
+			inW(0), inH(0), rawFormat(PIX_FMT_RGB24), raw(false),
+			outW(0), outH(0), bitRate(4000000), frameRate(25), codec("mpeg4"), numWorkers(0) {}
+
+		std::string input;
+		// raw input only, frames have no header so the size has to be given
+		int inW, inH;
+		PixelFormat rawFormat;
+		bool raw;
+
+		std::string output;
+		// 0 for the input size
+		int outW, outH;
+		int bitRate;
+		int frameRate;
+		std::string codec;
+		// empty for the output's extension
+		std::string container;
+		// image decoding threads, 0 for one per core
+		int numWorkers;
+	};
+
+	// fixed set of frame buffers shared between reading and the exporter, reading waits
+	// for the encoder once they're all in use so memory stays flat however long the input
+	class BufferPool
+	{
+	public:
+		BufferPool(ThreadFactory* threads) : threads(threads), size(0) { mutex = threads->createMutex(); }
+		~BufferPool() { clear(); delete mutex; }
+
+		void allocate(int size, int numBuffers)
+		{
+			clear();
+			this->size = size;
+			ScopedLock lock(mutex);
+			for (int i = 0; i < numBuffers; i++) buffers.push_back(new unsigned char[size]);
+			freeBuffers = buffers;
+		}
+
+		// waits for every buffer to come back
+		void clear()
+		{
+			while (true)
+			{
+				{
+					ScopedLock lock(mutex);
+					if (freeBuffers.size() == buffers.size()) break;
+				}
+				threads->sleepMillis(1);
+			}
+			for (unsigned i = 0; i < buffers.size(); i++) delete[] buffers[i];
+			buffers.clear();
+			freeBuffers.clear();
+		}
+
+		// waits for one if they're all in use
+		unsigned char* acquire()
+		{
+			while (true)
+			{
+				{
+					ScopedLock lock(mutex);
+					if (!freeBuffers.empty())
+					{
+						unsigned char* pixels = freeBuffers.back();
+						freeBuffers.pop_back();
+						return pixels;
+					}
+				}
+				threads->sleepMillis(1);
+			}
+		}
+
+		// FrameReleaseCallback, called by the exporter once a frame has been encoded
+		static void release(unsigned char* pixels, void* userData)
+		{
+			BufferPool* pool = (BufferPool*)userData;
+			ScopedLock lock(pool->mutex);
+			pool->freeBuffers.push_back(pixels);
+		}
+
+	private:
+		ThreadFactory* threads;
+		Mutex* mutex;
+		std::vector<unsigned char*> buffers;
+		std::vector<unsigned char*> freeBuffers;
+		int size;
+	};
+
+	class Input
+	{
+	public:
+		virtual ~Input() {}
+		virtual bool open(const Options& options) = 0;
+		// hand the next frame to the exporter, false at the end of the input
+		virtual bool addNextFrame(MovieExporter& exporter) = 0;
+		// once the exporter has finished with the frames
+		virtual void close() = 0;
+		inline const FrameFormat& getFormat() const { return format; }
+		// frames that couldn't be read and were left out
+		virtual int getNumFramesFailed() const { return 0; }
+
+	protected:
+		FrameFormat format;
+	};
+
+	// headerless frames one after the other, from stdin or a file, e.g. the journal of an
+	// animated GIF or frames piped from a renderer
+	class RawInput : public Input
+	{
+	public:
+		// frames read ahead of the one being encoded
+		static const int NUM_BUFFERS = 8;
+
+		RawInput(ThreadFactory* threads) : file(NULL), pool(threads) {}
+
+		bool open(const Options& options)
+		{
+			if (options.inW <= 0 || options.inH <= 0)
+			{
+				fprintf(stderr, "Raw input needs its size, -s WxH\n");
+				return false;
+			}
+			file = options.input == "-" ? stdin : fopen(options.input.c_str(), "rb");
+			if (!file)
+			{
+				fprintf(stderr, "Could not open %s\n", options.input.c_str());
+				return false;
+			}
+			format = FrameFormat(options.inW, options.inH, options.rawFormat);
+			pool.allocate(format.getSize(), NUM_BUFFERS);
+			return true;
+		}
+
+		bool addNextFrame(MovieExporter& exporter)
+		{
+			unsigned char* pixels = pool.acquire();
+			if (fread(pixels, format.getSize(), 1, file) != 1)
+			{
+				BufferPool::release(pixels, &pool);
+				return false;
+			}
+			exporter.addFrame(pixels, &BufferPool::release, &pool);
+			return true;
+		}
+
+		void close()
+		{
+			if (file && file != stdin) fclose(file);
+			file = NULL;
+			pool.clear();
+		}
+
+	private:
+		FILE* file;
+		BufferPool pool;
+	};
+
+	// any movie libavformat can read, decoded on the reader's own thread
+	class MovieInput : public Input
+	{
+	public:
+		MovieInput(ThreadFactory* threads) : reader(NULL, threads) {}
+
+		bool open(const Options& options)
+		{
+			if (!reader.open(options.input)) return false;
+			format = reader.getFormat();
+			return true;
+		}
+
+		bool addNextFrame(MovieExporter& exporter)
+		{
+			Frame* frame = reader.readFrame();
+			if (!frame) return false;
+			exporter.addFrame(frame);
+			return true;
+		}
+
+		void close() { reader.close(); }
+
+	private:
+		MovieReader reader;
+	};
+
+	class SequenceInput;
+
+	// decodes whole image files with one of libav's image decoders, each worker has its own
+	class ImageDecoder : public Runnable
+	{
+	public:
+		ImageDecoder(SequenceInput* input) : input(input), codecCtx(NULL), picture(NULL) {}
+		~ImageDecoder() { close(); }
+
+		// libav only lets one thread open codecs at a time, call from the main thread
+		bool open(CodecID codecId)
+		{
+			AVCodec* codec = avcodec_find_decoder(codecId);
+			if (!codec) return false;
+			codecCtx = avcodec_alloc_context();
+			if (avcodec_open(codecCtx, codec) < 0)
+			{
+				av_free(codecCtx);
+				codecCtx = NULL;
+				return false;
+			}
+			picture = avcodec_alloc_frame();
+			return true;
+		}
+
+		void close()
+		{
+			if (codecCtx)
+			{
+				avcodec_close(codecCtx);
+				av_free(codecCtx);
+			}
+			if (picture) av_free(picture);
+			codecCtx = NULL;
+			picture = NULL;
+		}
+
+		// the layout of the image in filePath
+		bool probe(const std::string& filePath, FrameFormat& format)
+		{
+			if (!decode(filePath)) return false;
+			format = FrameFormat(codecCtx->width, codecCtx->height, codecCtx->pix_fmt);
+			return true;
+		}
+
+		// into pixels laid out as format, false if it couldn't be decoded or doesn't match
+		bool decode(const std::string& filePath, const FrameFormat& format, unsigned char* pixels)
+		{
+			if (!decode(filePath)) return false;
+			if (codecCtx->width != format.width || codecCtx->height != format.height || codecCtx->pix_fmt != format.pixelFormat)
+			{
+				fprintf(stderr, "%s is %dx%d %s, not like the first image\n", filePath.c_str(), codecCtx->width, codecCtx->height, av_get_pix_fmt_name(codecCtx->pix_fmt));
+				return false;
+			}
+			unsigned char* planes[FrameFormat::MAX_PLANES];
+			format.fillPlanes(pixels, planes);
+			int strides[FrameFormat::MAX_PLANES];
+			for (int i = 0; i < FrameFormat::MAX_PLANES; i++) strides[i] = format.strides[i];
+			av_image_copy(planes, strides, (const uint8_t**)picture->data, picture->linesize, format.pixelFormat, format.width, format.height);
+			return true;
+		}
+
+		void run();
+
+	private:
+		bool decode(const std::string& filePath)
+		{
+			FILE* file = fopen(filePath.c_str(), "rb");
+			if (!file)
+			{
+				fprintf(stderr, "Could not open %s\n", filePath.c_str());
+				return false;
+			}
+			fseek(file, 0, SEEK_END);
+			long size = ftell(file);
+			fseek(file, 0, SEEK_SET);
+			// decoders read a little past the end
+			data.assign(size + FF_INPUT_BUFFER_PADDING_SIZE, 0);
+			bool read = size > 0 && fread(&data[0], size, 1, file) == 1;
+			fclose(file);
+			if (!read)
+			{
+				fprintf(stderr, "Could not read %s\n", filePath.c_str());
+				return false;
+			}
+
+			AVPacket packet;
+			av_init_packet(&packet);
+			packet.data = &data[0];
+			packet.size = size;
+			int gotPicture = 0;
+			if (avcodec_decode_video2(codecCtx, picture, &gotPicture, &packet) < 0 || !gotPicture)
+			{
+				fprintf(stderr, "Could not decode %s\n", filePath.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		SequenceInput* input;
+		AVCodecContext* codecCtx;
+		AVFrame* picture;
+		std::vector<uint8_t> data;
+	};
+
+	// numbered images, a printf style pattern like img_%05d.png counting up from 0 or 1.
+	// A pool of workers decodes the next few images in parallel, the frames are handed
+	// to the exporter in order
+	class SequenceInput : public Input
+	{
+	public:
+		// images decoded ahead of the one being added, per worker
+		static const int PREFETCH_PER_WORKER = 2;
+		// frames that can be waiting for or in the encoder
+		static const int ENCODER_BUFFERS = 8;
+
+		SequenceInput(ThreadFactory* threads) :
+			threads(threads), pool(threads), firstIndex(0), numFiles(0), nextClaim(0), nextOut(0), window(0), stopping(false), numFramesFailed(0)
+		{
+			mutex = threads->createMutex();
+		}
+
+		~SequenceInput()
+		{
+			close();
+			delete mutex;
+		}
+
+		bool open(const Options& options)
+		{
+			pattern = options.input;
+			// count the files, starting at 0 or 1
+			firstIndex = exists(getPath(0)) ? 0 : 1;
+			numFiles = 0;
+			while (exists(getPath(firstIndex + numFiles))) numFiles++;
+			if (numFiles == 0)
+			{
+				fprintf(stderr, "No images match %s\n", pattern.c_str());
+				return false;
+			}
+
+			CodecID codecId = getCodecId(pattern);
+			if (codecId == CODEC_ID_NONE)
+			{
+				fprintf(stderr, "Unknown image type %s, use png, jpg, tif, bmp, tga or ppm\n", pattern.c_str());
+				return false;
+			}
+
+			int numWorkers = options.numWorkers > 0 ? options.numWorkers : getNumCores();
+			for (int i = 0; i < numWorkers; i++)
+			{
+				ImageDecoder* decoder = new ImageDecoder(this);
+				decoders.push_back(decoder);
+				if (!decoder->open(codecId))
+				{
+					fprintf(stderr, "Could not open an image decoder\n");
+					close();
+					return false;
+				}
+			}
+			// the first image sets the format
+			if (!decoders[0]->probe(getPath(firstIndex), format))
+			{
+				close();
+				return false;
+			}
+
+			window = numWorkers * PREFETCH_PER_WORKER;
+			pool.allocate(format.getSize(), window + ENCODER_BUFFERS);
+			nextClaim = 0;
+			nextOut = 0;
+			stopping = false;
+			for (int i = 0; i < numWorkers; i++)
+			{
+				workers.push_back(threads->createThread());
+				workers.back()->start(decoders[i]);
+			}
+			return true;
+		}
+
+		bool addNextFrame(MovieExporter& exporter)
+		{
+			while (true)
+			{
+				unsigned char* pixels = NULL;
+				bool readable = false;
+				{
+					ScopedLock lock(mutex);
+					if (nextOut >= numFiles) return false;
+					std::map<int, unsigned char*>::iterator it = done.find(nextOut);
+					if (it != done.end())
+					{
+						pixels = it->second;
+						readable = failed.erase(nextOut) == 0;
+						done.erase(it);
+						nextOut++;
+					}
+				}
+				if (!pixels)
+				{
+					threads->sleepMillis(1);
+					continue;
+				}
+				if (readable)
+				{
+					exporter.addFrame(pixels, &BufferPool::release, &pool);
+					return true;
+				}
+				// left out, the frame before is shown for longer
+				BufferPool::release(pixels, &pool);
+				numFramesFailed++;
+			}
+		}
+
+		void close()
+		{
+			stopping = true;
+			for (unsigned i = 0; i < workers.size(); i++)
+			{
+				workers[i]->join();
+				delete workers[i];
+			}
+			workers.clear();
+			for (unsigned i = 0; i < decoders.size(); i++) delete decoders[i];
+			decoders.clear();
+			for (std::map<int, unsigned char*>::iterator it = done.begin(); it != done.end(); ++it)
+			{
+				BufferPool::release(it->second, &pool);
+			}
+			done.clear();
+			failed.clear();
+			pool.clear();
+		}
+
+		int getNumFramesFailed() const { return numFramesFailed; }
+
+	private:
+		friend class ImageDecoder;
+
+		// the next image for a worker, -1 once there are none left, waits while the
+		// workers are too far ahead of the exporter
+		int claim()
+		{
+			while (!stopping)
+			{
+				{
+					ScopedLock lock(mutex);
+					if (nextClaim >= numFiles) return -1;
+					if (nextClaim < nextOut + window) return nextClaim++;
+				}
+				threads->sleepMillis(1);
+			}
+			return -1;
+		}
+
+		void decoded(int index, unsigned char* pixels, bool succeeded)
+		{
+			ScopedLock lock(mutex);
+			done[index] = pixels;
+			if (!succeeded) failed.insert(index);
+		}
+
+		std::string getPath(int index) const
+		{
+			char path[4096];
+			snprintf(path, sizeof(path), pattern.c_str(), index);
+			return path;
+		}
+
+		static bool exists(const std::string& filePath)
+		{
+			FILE* file = fopen(filePath.c_str(), "rb");
+			if (file) fclose(file);
+			return file != NULL;
+		}
+
+		static CodecID getCodecId(const std::string& filePath)
+		{
+			std::string extension = filePath.substr(filePath.find_last_of('.') + 1);
+			for (unsigned i = 0; i < extension.size(); i++) extension[i] = tolower(extension[i]);
+			if (extension == "png") return CODEC_ID_PNG;
+			if (extension == "jpg" || extension == "jpeg") return CODEC_ID_MJPEG;
+			if (extension == "tif" || extension == "tiff") return CODEC_ID_TIFF;
+			if (extension == "bmp") return CODEC_ID_BMP;
+			if (extension == "tga") return CODEC_ID_TARGA;
+			if (extension == "ppm") return CODEC_ID_PPM;
+			if (extension == "pgm") return CODEC_ID_PGM;
+			return CODEC_ID_NONE;
+		}
+
+		ThreadFactory* threads;
+		BufferPool pool;
+		std::vector<ImageDecoder*> decoders;
+		std::vector<Thread*> workers;
+
+		std::string pattern;
+		int firstIndex;
+		int numFiles;
+
+		Mutex* mutex;
+		// decoded images waiting for their turn, by position in the sequence
+		std::map<int, unsigned char*> done;
+		std::set<int> failed;
+		int nextClaim;
+		int nextOut;
+		int window;
+		volatile bool stopping;
+		int numFramesFailed;
+	};
+
+	void ImageDecoder::run()
+	{
+		while (true)
+		{
+			int index = input->claim();
+			if (index < 0) return;
+			unsigned char* pixels = input->pool.acquire();
+			bool succeeded = decode(input->getPath(input->firstIndex + index), input->format, pixels);
+			input->decoded(index, pixels, succeeded);
+		}
+	}
+
+	void onFinished(const std::string& /*filePath*/, bool succeeded, void* userData)
+	{
+		if (!succeeded) *(bool*)userData = false;
+	}
+
+	bool parseSize(const char* arg, int& w, int& h)
+	{
+		return sscanf(arg, "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+	}
+
+	void printUsage()
+	{
+		fprintf(stderr,
+			"usage: movieExporterCli -i <input> -o <output> [options]\n"
+			"  -i <input>       img_%%05d.png (png jpg tif bmp tga ppm), a movie, or raw frames, - for stdin\n"
+			"  -o <output>      file or URL to write\n"
+			"  -s <WxH>         size of raw frames\n"
+			"  -p <pix_fmt>     pixel format of raw frames, default rgb24\n"
+			"  --raw            read the input as raw frames\n"
+			"  -S <WxH>         output size, default the input's\n"
+			"  -r <fps>         frame rate, default 25\n"
+			"  -b <bits/s>      bit rate, default 4000000\n"
+			"  -c <codec>       encoder name, default mpeg4\n"
+			"  -f <container>   container, default the output's extension\n"
+			"  -j <threads>     image decoding threads, default one per core\n");
+	}
+
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--raw")
+			{
+				options.raw = true;
+				continue;
+			}
+			if (i + 1 >= argc)
+			{
+				fprintf(stderr, "%s needs a value\n", arg.c_str());
+				return false;
+			}
+			const char* value = argv[++i];
+			if (arg == "-i") options.input = value;
+			else if (arg == "-o") options.output = value;
+			else if (arg == "-s")
+			{
+				if (!parseSize(value, options.inW, options.inH)) return false;
+			}
+			else if (arg == "-S")
+			{
+				if (!parseSize(value, options.outW, options.outH)) return false;
+			}
+			else if (arg == "-p")
+			{
+				options.rawFormat = av_get_pix_fmt(value);
+				if (options.rawFormat == PIX_FMT_NONE)
+				{
+					fprintf(stderr, "Unknown pixel format %s\n", value);
+					return false;
+				}
+			}
+			else if (arg == "-r") options.frameRate = atoi(value);
+			else if (arg == "-b") options.bitRate = atoi(value);
+			else if (arg == "-c") options.codec = value;
+			else if (arg == "-f") options.container = value;
+			else if (arg == "-j") options.numWorkers = atoi(value);
+			else
+			{
+				fprintf(stderr, "Unknown option %s\n", arg.c_str());
+				return false;
+			}
+		}
+		if (options.input.empty() || options.output.empty() || options.frameRate <= 0 || options.bitRate <= 0) return false;
+		if (options.input == "-") options.raw = true;
+		if (options.container.empty())
+		{
+			size_t dot = options.output.find_last_of('.');
+			if (dot != std::string::npos) options.container = options.output.substr(dot + 1);
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	av_register_all();
+	AVCodec* codec = avcodec_find_encoder_by_name(options.codec.c_str());
+	if (!codec || codec->type != AVMEDIA_TYPE_VIDEO)
+	{
+		fprintf(stderr, "Unknown video encoder %s\n", options.codec.c_str());
+		return 1;
+	}
+
+	ThreadFactory* threads = getDefaultThreadFactory();
+	Input* input = NULL;
+	if (options.raw) input = new RawInput(threads);
+	else if (options.input.find('%') != std::string::npos) input = new SequenceInput(threads);
+	else input = new MovieInput(threads);
+	if (!input->open(options))
+	{
+		delete input;
+		return 1;
+	}
+
+	const FrameFormat& format = input->getFormat();
+	int outW = options.outW > 0 ? options.outW : format.width;
+	int outH = options.outH > 0 ? options.outH : format.height;
+	fprintf(stderr, "%dx%d %s -> %s %dx%d %s %d fps %d bits/s\n", format.width, format.height, av_get_pix_fmt_name(format.pixelFormat),
+		options.output.c_str(), outW, outH, codec->name, options.frameRate, options.bitRate);
+
+	bool succeeded = true;
+	MovieExporter exporter;
+	// frames are read as fast as they're encoded, not in real time
+	exporter.setOffline(true);
+	exporter.setup(format, outW, outH, options.bitRate, options.frameRate, codec->id, options.container);
+	exporter.setFinishedCallback(&onFinished, &succeeded);
+
+	float start = exporter.getClock()->getElapsedTimef();
+	int numFrames = 0;
+	if (exporter.record(options.output))
+	{
+		while (input->addNextFrame(exporter)) numFrames++;
+		exporter.stop();
+		exporter.waitForRecordings();
+	}
+	else succeeded = false;
+	float seconds = exporter.getClock()->getElapsedTimef() - start;
+	input->close();
+
+	// the throughput of the whole pipeline, reading included
+	fprintf(stderr, "%d frames in %.2fs, %.1f fps, %d encoded, %d dropped, %d unreadable\n", numFrames, seconds,
+		seconds > 0.f ? numFrames / seconds : 0.f, exporter.getNumFramesEncoded(), exporter.getNumFramesDropped(), input->getNumFramesFailed());
+	delete input;
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,539 @@
+/*
+ *  AnimatedGif.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "AnimatedGif.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace itg
+{
+	namespace
+	{
+		// journals of long takes go past 2GB
+		bool seekFile(FILE* file, int64_t offset)
+		{
+#ifdef _WIN32
+			return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+			return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+		}
+
+		// little endian
+		void writeShort(FILE* file, int value)
+		{
+			fputc(value & 0xff, file);
+			fputc((value >> 8) & 0xff, file);
+		}
+	}
+
+	AnimatedGifSettings::AnimatedGifSettings() :
+		outW(0), outH(0),
+		frameInterval(0.04f),
+		dither(true),
+		numWorkers(0),
+		finished(NULL),
+		finishedUserData(NULL)
+	{
+	}
+
+	GifFrame::GifFrame() : x(0), y(0), width(0), height(0), unchanged(false)
+	{
+	}
+
+	GifWorker::GifWorker(AnimatedGif* gif, Logger* logger) :
+		gif(gif), logger(logger), journal(NULL)
+	{
+	}
+
+	GifWorker::~GifWorker()
+	{
+		close();
+	}
+
+	bool GifWorker::open(const std::string& journalPath)
+	{
+		close();
+		journal = fopen(journalPath.c_str(), "rb");
+		if (!journal)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not read back %s", journalPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void GifWorker::close()
+	{
+		if (journal) fclose(journal);
+		journal = NULL;
+	}
+
+	GifFrame* GifWorker::encode(int index)
+	{
+		GifFrame* frame = new GifFrame();
+		int w = gif->settings.outW;
+		int h = gif->settings.outH;
+		int rowBytes = 3 * w;
+
+		if (!readFrame(index, current) || (index > 0 && !readFrame(index - 1, previous)))
+		{
+			gif->failed = true;
+			frame->unchanged = true;
+			return frame;
+		}
+
+		// bounding box of the pixels that changed, the first frame is always whole
+		int top = 0;
+		int bottom = h - 1;
+		int left = 0;
+		int right = w - 1;
+		if (index > 0)
+		{
+			while (top < h && !memcmp(&current[top * rowBytes], &previous[top * rowBytes], rowBytes)) top++;
+			if (top == h)
+			{
+				frame->unchanged = true;
+				return frame;
+			}
+			while (bottom > top && !memcmp(&current[bottom * rowBytes], &previous[bottom * rowBytes], rowBytes)) bottom--;
+
+			left = w;
+			right = -1;
+			for (int y = top; y <= bottom; y++)
+			{
+				const unsigned char* a = &current[y * rowBytes];
+				const unsigned char* b = &previous[y * rowBytes];
+				int x = 0;
+				while (x < left && !memcmp(a + 3 * x, b + 3 * x, 3)) x++;
+				left = std::min(left, x);
+				x = w - 1;
+				while (x > right && !memcmp(a + 3 * x, b + 3 * x, 3)) x--;
+				right = std::max(right, x);
+			}
+		}
+
+		frame->x = left;
+		frame->y = top;
+		frame->width = right - left + 1;
+		frame->height = bottom - top + 1;
+		indices.resize(frame->width * frame->height);
+		gif->palette.quantize(&current[0], rowBytes, frame->x, frame->y, frame->width, frame->height, gif->settings.dither, &indices[0]);
+		lzw.encode(&indices[0], indices.size(), frame->data);
+		return frame;
+	}
+
+#ifdef _THREAD_CAPTURE
+	void GifWorker::run()
+	{
+		while (true)
+		{
+			int index = gif->takeJob();
+			if (index == AnimatedGif::NO_MORE_JOBS) break;
+			if (index == AnimatedGif::WAIT_FOR_JOB)
+			{
+				gif->threads->sleepMillis(1);
+				continue;
+			}
+			gif->putResult(index, encode(index));
+		}
+	}
+#endif
+
+	bool GifWorker::readFrame(int index, std::vector<unsigned char>& pixels)
+	{
+		int frameSize = 3 * gif->settings.outW * gif->settings.outH;
+		pixels.resize(frameSize);
+		if (!seekFile(journal, (int64_t)index * frameSize) || fread(&pixels[0], 1, frameSize, journal) != (size_t)frameSize)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not read frame %d back from the journal", index);
+			return false;
+		}
+		return true;
+	}
+
+	AnimatedGif::AnimatedGif(Logger* logger, ThreadFactory* threads) :
+#ifdef _THREAD_CAPTURE
+		thread(NULL),
+		threadRunning(false),
+		nextJob(0),
+		nextWrite(0),
+#endif
+		logger(logger),
+		threads(threads),
+		frameQueue(threads),
+		recording(false),
+		failed(false),
+		numFramesWritten(0),
+		journal(NULL),
+		file(NULL),
+		rgbFrame(NULL),
+		rgbPixels(NULL)
+	{
+#ifdef _THREAD_CAPTURE
+		thread = threads->createThread();
+		jobMutex = threads->createMutex();
+#endif
+	}
+
+	AnimatedGif::~AnimatedGif()
+	{
+		stop();
+		join();
+		clearWorkers();
+		av_free(rgbFrame);
+		av_free(rgbPixels);
+#ifdef _THREAD_CAPTURE
+		delete thread;
+		delete jobMutex;
+#endif
+	}
+
+	bool AnimatedGif::start(const AnimatedGifSettings& settings, const std::string& filePath)
+	{
+		if (recording) return false;
+		// the previous GIF may still be being written
+		join();
+
+		this->settings = settings;
+		this->filePath = filePath;
+		journalPath = filePath + ".journal";
+		journal = fopen(journalPath.c_str(), "wb");
+		if (!journal)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open %s", journalPath.c_str());
+			return false;
+		}
+
+		converter.setup(settings.inFormat, settings.outW, settings.outH, PIX_FMT_RGB24);
+		av_free(rgbFrame);
+		av_free(rgbPixels);
+		rgbPixels = (unsigned char*)av_malloc(avpicture_get_size(PIX_FMT_RGB24, settings.outW, settings.outH));
+		rgbFrame = avcodec_alloc_frame();
+		avpicture_fill((AVPicture*)rgbFrame, rgbPixels, PIX_FMT_RGB24, settings.outW, settings.outH);
+
+		histogram.clear();
+		times.clear();
+		failed = false;
+		numFramesWritten = 0;
+		recording = true;
+#ifdef _THREAD_CAPTURE
+		threadRunning = true;
+		thread->start(this);
+#endif
+		return true;
+	}
+
+	void AnimatedGif::stop()
+	{
+		if (!recording) return;
+		recording = false;
+#ifndef _THREAD_CAPTURE
+		finish();
+#endif
+	}
+
+	bool AnimatedGif::isIdle()
+	{
+#ifdef _THREAD_CAPTURE
+		return !recording && !threadRunning;
+#else
+		return !recording;
+#endif
+	}
+
+	void AnimatedGif::join()
+	{
+#ifdef _THREAD_CAPTURE
+		thread->join();
+#endif
+	}
+
+	void AnimatedGif::addFrame(Frame* frame)
+	{
+		if (!recording)
+		{
+			frame->release();
+			return;
+		}
+#ifdef _THREAD_CAPTURE
+		frameQueue.push(frame);
+#else
+		journalFrame(frame);
+		frame->release();
+#endif
+	}
+
+// PRIVATE
+
+#ifdef _THREAD_CAPTURE
+	void AnimatedGif::run()
+	{
+		// first pass, while recording
+		while (true)
+		{
+			// recording is cleared after the last frame is queued so read it before popping
+			bool stopping = !recording;
+			memoryBarrier();
+
+			Frame* frame = frameQueue.pop();
+			if (frame)
+			{
+				journalFrame(frame);
+				frame->release();
+			}
+			else if (stopping) break;
+			else threads->sleepMillis(1);
+		}
+		finish();
+		threadRunning = false;
+	}
+
+	int AnimatedGif::takeJob()
+	{
+		ScopedLock lock(jobMutex);
+		if (nextJob >= (int)times.size()) return NO_MORE_JOBS;
+		// keeps the frames waiting to be written, and so memory, bounded
+		if (nextJob >= nextWrite + FRAMES_PER_WORKER * (int)workers.size()) return WAIT_FOR_JOB;
+		return nextJob++;
+	}
+
+	void AnimatedGif::putResult(int index, GifFrame* frame)
+	{
+		ScopedLock lock(jobMutex);
+		results[index] = frame;
+	}
+
+	GifFrame* AnimatedGif::waitForResult(int index)
+	{
+		while (true)
+		{
+			{
+				ScopedLock lock(jobMutex);
+				std::map<int, GifFrame*>::iterator it = results.find(index);
+				if (it != results.end())
+				{
+					GifFrame* frame = it->second;
+					results.erase(it);
+					nextWrite = index + 1;
+					return frame;
+				}
+			}
+			threads->sleepMillis(1);
+		}
+	}
+#endif
+
+	void AnimatedGif::journalFrame(Frame* frame)
+	{
+		if (failed) return;
+		converter.convert(frame->planes, rgbFrame);
+		int numPixels = settings.outW * settings.outH;
+		histogram.add(rgbPixels, numPixels);
+		if (fwrite(rgbPixels, 1, 3 * numPixels, journal) != (size_t)(3 * numPixels))
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not write to %s", journalPath.c_str());
+			failed = true;
+			return;
+		}
+		times.push_back(frame->time);
+	}
+
+	void AnimatedGif::finish()
+	{
+		fclose(journal);
+		journal = NULL;
+
+		bool succeeded = !failed;
+		if (times.empty())
+		{
+			logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: No frames were recorded for %s", filePath.c_str());
+			succeeded = false;
+		}
+		if (succeeded) succeeded = writeFrames();
+		remove(journalPath.c_str());
+
+		if (succeeded) logger->log(EXPORTER_LOG_NOTICE, "ofxMovieExporter: Wrote %d frames to %s", (int)numFramesWritten, filePath.c_str());
+		if (settings.finished) settings.finished(filePath, succeeded, settings.finishedUserData);
+	}
+
+	bool AnimatedGif::writeFrames()
+	{
+		palette.build(histogram);
+
+		file = fopen(filePath.c_str(), "wb");
+		if (!file)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open %s", filePath.c_str());
+			return false;
+		}
+		writeHeader();
+
+#ifdef _THREAD_CAPTURE
+		int numWorkers = settings.numWorkers > 0 ? settings.numWorkers : getNumCores();
+#else
+		int numWorkers = 1;
+#endif
+		for (int i = 0; i < numWorkers; i++)
+		{
+			workers.push_back(new GifWorker(this, logger));
+			if (!workers.back()->open(journalPath))
+			{
+				clearWorkers();
+				fclose(file);
+				file = NULL;
+				return false;
+			}
+		}
+#ifdef _THREAD_CAPTURE
+		nextJob = 0;
+		nextWrite = 0;
+		for (int i = 0; i < numWorkers; i++)
+		{
+			workerThreads.push_back(threads->createThread());
+			workerThreads.back()->start(workers[i]);
+		}
+#endif
+
+		// GIF delays are in hundredths, the rounding error is carried so the
+		// total length matches the recording.  Unchanged frames aren't written,
+		// the frame before is shown for longer
+		GifFrame* pending = NULL;
+		int pendingDelay = 0;
+		int elapsed = 0;
+		int numFrames = times.size();
+		for (int i = 0; i < numFrames; i++)
+		{
+#ifdef _THREAD_CAPTURE
+			GifFrame* frame = waitForResult(i);
+#else
+			GifFrame* frame = workers[0]->encode(i);
+#endif
+			float end = i + 1 < numFrames ? times[i + 1] : times[i] + settings.frameInterval;
+			int endHundredths = (int)(100.f * (end - times[0]) + 0.5f);
+			int delay = endHundredths - elapsed;
+			elapsed = endHundredths;
+
+			if (frame->unchanged && pending)
+			{
+				pendingDelay += delay;
+				delete frame;
+				continue;
+			}
+			if (pending)
+			{
+				writeFrame(*pending, pendingDelay);
+				delete pending;
+			}
+			pending = frame;
+			pendingDelay = delay;
+		}
+		if (pending)
+		{
+			writeFrame(*pending, pendingDelay);
+			delete pending;
+		}
+		clearWorkers();
+
+		fputc(0x3b, file);
+		bool succeeded = !failed && !ferror(file);
+		succeeded = fclose(file) == 0 && succeeded;
+		file = NULL;
+		if (!succeeded) logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not write %s", filePath.c_str());
+		return succeeded;
+	}
+
+	void AnimatedGif::writeHeader()
+	{
+		fwrite("GIF89a", 1, 6, file);
+		writeShort(file, settings.outW);
+		writeShort(file, settings.outH);
+		// global colour table of 256 colours, 8 bits per channel
+		fputc(0xf7, file);
+		fputc(0, file);
+		fputc(0, file);
+		fwrite(palette.getColors(), 1, 3 * GifPalette::NUM_COLORS, file);
+
+		// loop forever
+		fputc(0x21, file);
+		fputc(0xff, file);
+		fputc(11, file);
+		fwrite("NETSCAPE2.0", 1, 11, file);
+		fputc(3, file);
+		fputc(1, file);
+		writeShort(file, 0);
+		fputc(0, file);
+	}
+
+	void AnimatedGif::writeFrame(const GifFrame& frame, int delay)
+	{
+		// graphic control extension, each frame is left in place and the next drawn on top
+		fputc(0x21, file);
+		fputc(0xf9, file);
+		fputc(4, file);
+		fputc(1 << 2, file);
+		writeShort(file, std::min(std::max(delay, 0), 0xffff));
+		fputc(0, file);
+		fputc(0, file);
+
+		// image descriptor, no local colour table
+		fputc(0x2c, file);
+		writeShort(file, frame.x);
+		writeShort(file, frame.y);
+		writeShort(file, frame.width);
+		writeShort(file, frame.height);
+		fputc(0, file);
+		fwrite(&frame.data[0], 1, frame.data.size(), file);
+		numFramesWritten++;
+	}
+
+	void AnimatedGif::clearWorkers()
+	{
+#ifdef _THREAD_CAPTURE
+		for (unsigned i = 0; i < workerThreads.size(); i++)
+		{
+			delete workerThreads[i];
+		}
+		workerThreads.clear();
+		for (std::map<int, GifFrame*>::iterator it = results.begin(); it != results.end(); ++it)
+		{
+			delete it->second;
+		}
+		results.clear();
+#endif
+		for (unsigned i = 0; i < workers.size(); i++)
+		{
+			delete workers[i];
+		}
+		workers.clear();
+	}
+}
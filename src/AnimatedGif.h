@@ -0,0 +1,196 @@
+/*
+ *  AnimatedGif.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+#include "FrameConverter.h"
+#include "GifEncoder.h"
+#include "Recording.h"
+
+namespace itg
+{
+	class AnimatedGif;
+
+	struct AnimatedGifSettings
+	{
+		AnimatedGifSettings();
+
+		FrameFormat inFormat;
+		int outW, outH;
+		// how long the last frame is shown for
+		float frameInterval;
+		bool dither;
+		// 0 for one per core
+		int numWorkers;
+
+		RecordingFinishedCallback finished;
+		void* finishedUserData;
+	};
+
+	// the part of a frame that changed since the one before, compressed
+	struct GifFrame
+	{
+		GifFrame();
+
+		int x, y, width, height;
+		// nothing changed, the frame before is shown for longer instead
+		bool unchanged;
+		std::vector<unsigned char> data;
+	};
+
+	// second pass, reads frames back from the journal and dithers and compresses them
+	class GifWorker
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		GifWorker(AnimatedGif* gif, Logger* logger);
+		~GifWorker();
+
+		// each worker reads the journal through its own file
+		bool open(const std::string& journalPath);
+		void close();
+		GifFrame* encode(int index);
+
+	private:
+#ifdef _THREAD_CAPTURE
+		void run();
+#endif
+		bool readFrame(int index, std::vector<unsigned char>& pixels);
+
+		AnimatedGif* gif;
+		Logger* logger;
+		FILE* journal;
+		std::vector<unsigned char> current;
+		std::vector<unsigned char> previous;
+		std::vector<unsigned char> indices;
+		GifLzw lzw;
+	};
+
+	// an animated GIF of a take, in two passes so memory doesn't grow with its length.
+	// While recording, frames are scaled to RGB, counted into a colour histogram and
+	// appended to a raw journal next to the file.  After stop() a palette is built from
+	// the histogram and a pool of workers reads the frames back, works out which part
+	// of each changed, dithers and compresses it, and the GIF is written in order
+	class AnimatedGif
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		// how many frames each worker can be ahead of the one being written
+		static const int FRAMES_PER_WORKER = 2;
+
+		AnimatedGif(Logger* logger, ThreadFactory* threads);
+		// waits for the GIF to be finished
+		~AnimatedGif();
+
+		bool start(const AnimatedGifSettings& settings, const std::string& filePath);
+		// returns straight away, the GIF is written in the background
+		void stop();
+		// not recording or writing
+		bool isIdle();
+		// block until idle
+		void join();
+
+		inline bool isRecording() const { return recording; }
+		inline const std::string& getFilePath() const { return filePath; }
+
+		// takes over the caller's reference
+		void addFrame(Frame* frame);
+
+		inline int getNumFramesWritten() const { return numFramesWritten; }
+
+	private:
+		friend class GifWorker;
+
+#ifdef _THREAD_CAPTURE
+		void run();
+		// for the workers, the next frame to encode, WAIT_FOR_JOB if they're too far ahead
+		// or NO_MORE_JOBS
+		int takeJob();
+		void putResult(int index, GifFrame* frame);
+		GifFrame* waitForResult(int index);
+
+		static const int WAIT_FOR_JOB = -1;
+		static const int NO_MORE_JOBS = -2;
+
+		Thread* thread;
+		volatile bool threadRunning;
+		std::vector<Thread*> workerThreads;
+		Mutex* jobMutex;
+		int nextJob;
+		int nextWrite;
+		std::map<int, GifFrame*> results;
+#endif
+		void journalFrame(Frame* frame);
+		// second pass, writes the GIF and removes the journal
+		void finish();
+		bool writeFrames();
+		void writeHeader();
+		void writeFrame(const GifFrame& frame, int delay);
+		void clearWorkers();
+
+		Logger* logger;
+		ThreadFactory* threads;
+
+		// only used as a queue, the frames belong to the exporter's pool
+		FrameQueue frameQueue;
+
+		AnimatedGifSettings settings;
+		std::string filePath;
+		std::string journalPath;
+		volatile bool recording;
+		// something couldn't be read or written
+		volatile bool failed;
+		volatile int numFramesWritten;
+
+		FILE* journal;
+		FILE* file;
+		FrameConverter converter;
+		AVFrame* rgbFrame;
+		unsigned char* rgbPixels;
+		ColorHistogram histogram;
+		GifPalette palette;
+		// capture time of each journalled frame
+		std::vector<float> times;
+
+		std::vector<GifWorker*> workers;
+	};
+}
@@ -0,0 +1,214 @@
+/*
+ *  AudioEncoder.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "AudioEncoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace itg
+{
+	AudioEncoder::AudioEncoder(Logger* logger) :
+		logger(logger), stream(NULL), codec(NULL), codecCtx(NULL), resampleCtx(NULL), encodedBuf(NULL), opened(false),
+		inSampleRate(0), numChannels(0), frameSize(0), samplesEncoded(0), pts(0), pendingStart(0), pendingEnd(0)
+	{
+		encodedBuf = (unsigned char*)av_malloc(ENCODED_FRAME_BUFFER_SIZE);
+	}
+
+	AudioEncoder::~AudioEncoder()
+	{
+		close();
+		av_free(encodedBuf);
+	}
+
+	bool AudioEncoder::configure(AVStream* stream, CodecID codecId, int sampleRate, int numChannels, int bitRate, bool globalHeader)
+	{
+		codec = avcodec_find_encoder(codecId);
+		if (!codec)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Audio codec not found");
+			return false;
+		}
+
+		this->stream = stream;
+		this->inSampleRate = sampleRate;
+		this->numChannels = numChannels;
+		codecCtx = stream->codec;
+		codecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
+		codecCtx->codec_id = codecId;
+		codecCtx->bit_rate = bitRate;
+		codecCtx->channels = numChannels;
+
+		// closest rate the codec can do, we resample if it isn't ours
+		codecCtx->sample_rate = sampleRate;
+		if (codec->supported_samplerates)
+		{
+			codecCtx->sample_rate = codec->supported_samplerates[0];
+			for (const int* rate = codec->supported_samplerates; *rate; rate++)
+			{
+				if (abs(*rate - sampleRate) < abs(codecCtx->sample_rate - sampleRate)) codecCtx->sample_rate = *rate;
+			}
+		}
+
+		// we can feed 16 bit or float
+		codecCtx->sample_fmt = AV_SAMPLE_FMT_S16;
+		if (codec->sample_fmts)
+		{
+			codecCtx->sample_fmt = AV_SAMPLE_FMT_NONE;
+			for (const AVSampleFormat* fmt = codec->sample_fmts; *fmt != AV_SAMPLE_FMT_NONE; fmt++)
+			{
+				if (*fmt == AV_SAMPLE_FMT_S16 || (*fmt == AV_SAMPLE_FMT_FLT && codecCtx->sample_fmt == AV_SAMPLE_FMT_NONE)) codecCtx->sample_fmt = *fmt;
+			}
+			if (codecCtx->sample_fmt == AV_SAMPLE_FMT_NONE)
+			{
+				logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Audio codec doesn't take 16 bit or float samples");
+				return false;
+			}
+		}
+
+		codecCtx->time_base.num = 1;
+		codecCtx->time_base.den = codecCtx->sample_rate;
+		stream->time_base = codecCtx->time_base;
+
+		// the built in AAC encoder is still marked experimental
+		codecCtx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+		if (globalHeader) codecCtx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+		return true;
+	}
+
+	bool AudioEncoder::open()
+	{
+		if (avcodec_open(codecCtx, codec) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open audio codec");
+			return false;
+		}
+		opened = true;
+
+		frameSize = codecCtx->frame_size > 1 ? codecCtx->frame_size : DEFAULT_FRAME_SIZE;
+		if (codecCtx->sample_rate != inSampleRate)
+		{
+			resampleCtx = av_audio_resample_init(numChannels, numChannels, codecCtx->sample_rate, inSampleRate, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16, 16, 10, 0, 0.8);
+		}
+
+		samplesEncoded = 0;
+		pts = 0;
+		pendingStart = 0;
+		pendingEnd = 0;
+		pending.resize(8 * frameSize * numChannels);
+		floatFrame.resize(frameSize * numChannels);
+		return true;
+	}
+
+	void AudioEncoder::close()
+	{
+		if (resampleCtx) audio_resample_close(resampleCtx);
+		resampleCtx = NULL;
+		// the context itself belongs to the stream and is freed by the muxer
+		if (opened) avcodec_close(codecCtx);
+		opened = false;
+		codecCtx = NULL;
+		stream = NULL;
+	}
+
+	void AudioEncoder::addSamples(const float* samples, int numFrames)
+	{
+		int numSamples = numFrames * numChannels;
+		if ((int)converted.size() < numSamples) converted.resize(numSamples);
+		for (int i = 0; i < numSamples; i++)
+		{
+			float sample = samples[i] < -1.f ? -1.f : (samples[i] > 1.f ? 1.f : samples[i]);
+			converted[i] = (short)(sample * 32767.f);
+		}
+
+		short* out = &converted[0];
+		if (resampleCtx)
+		{
+			// + a bit for the filter
+			int maxFrames = (int)((int64_t)numFrames * codecCtx->sample_rate / inSampleRate) + 32;
+			if ((int)resampled.size() < maxFrames * numChannels) resampled.resize(maxFrames * numChannels);
+			numFrames = audio_resample(resampleCtx, &resampled[0], &converted[0], numFrames);
+			numSamples = numFrames * numChannels;
+			out = &resampled[0];
+		}
+
+		// move what's left to the front before growing
+		if (pendingEnd + numSamples > (int)pending.size())
+		{
+			std::copy(pending.begin() + pendingStart, pending.begin() + pendingEnd, pending.begin());
+			pendingEnd -= pendingStart;
+			pendingStart = 0;
+			if (pendingEnd + numSamples > (int)pending.size()) pending.resize(pendingEnd + numSamples);
+		}
+		std::copy(out, out + numSamples, pending.begin() + pendingEnd);
+		pendingEnd += numSamples;
+	}
+
+	int AudioEncoder::encode(bool flush)
+	{
+		int frameSamples = frameSize * numChannels;
+		int queued = pendingEnd - pendingStart;
+		if (queued == 0 && flush && (codec->capabilities & CODEC_CAP_DELAY))
+		{
+			// get back the frames the codec is still holding on to
+			int outSize = avcodec_encode_audio(codecCtx, encodedBuf, ENCODED_FRAME_BUFFER_SIZE, NULL);
+			if (outSize <= 0) return -1;
+			pts = samplesEncoded;
+			samplesEncoded += frameSize;
+			return outSize;
+		}
+		if (queued == 0 || (queued < frameSamples && !flush)) return -1;
+
+		if (queued < frameSamples)
+		{
+			// pad the last frame with silence
+			if (pendingStart + frameSamples > (int)pending.size()) pending.resize(pendingStart + frameSamples);
+			std::fill(pending.begin() + pendingEnd, pending.begin() + pendingStart + frameSamples, 0);
+		}
+
+		const short* samples = &pending[pendingStart];
+		if (codecCtx->sample_fmt == AV_SAMPLE_FMT_FLT)
+		{
+			for (int i = 0; i < frameSamples; i++) floatFrame[i] = samples[i] / 32768.f;
+			samples = (const short*)&floatFrame[0];
+		}
+
+		// codecs without a fixed frame size work out the number of samples from the buffer size
+		int bufSize = codecCtx->frame_size > 1 ? ENCODED_FRAME_BUFFER_SIZE : frameSamples * av_get_bits_per_sample(codecCtx->codec_id) / 8;
+		int outSize = avcodec_encode_audio(codecCtx, encodedBuf, bufSize, samples);
+
+		pendingStart += queued < frameSamples ? queued : frameSamples;
+		if (pendingStart == pendingEnd) pendingStart = pendingEnd = 0;
+		pts = samplesEncoded;
+		samplesEncoded += frameSize;
+		return outSize > 0 ? outSize : 0;
+	}
+}
@@ -0,0 +1,95 @@
+/*
+ *  AudioEncoder.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+
+namespace itg
+{
+	// the audio codec side of a recording, takes interleaved float samples and
+	// converts and resamples them to whatever the codec wants
+	class AudioEncoder
+	{
+	public:
+		static const int ENCODED_FRAME_BUFFER_SIZE = 65536;
+		// samples per channel per packet for codecs like PCM that take any number
+		static const int DEFAULT_FRAME_SIZE = 1024;
+
+		AudioEncoder(Logger* logger);
+		~AudioEncoder();
+
+		// find the codec and set up the stream's codec context, the codec runs at the closest
+		// rate it supports to sampleRate
+		bool configure(AVStream* stream, CodecID codecId, int sampleRate, int numChannels, int bitRate, bool globalHeader);
+		// open the codec, call once the muxer has had its parameters set
+		bool open();
+		void close();
+
+		// interleaved samples at the rate and channel count given to configure()
+		void addSamples(const float* samples, int numFrames);
+		// encode one codec frame if a whole one is queued, flush pads a partial frame with silence
+		// and then drains codecs that hold frames back, returns the number of bytes written to
+		// getEncodedData(), 0 if the codec kept the frame or -1 once there is nothing left to encode
+		int encode(bool flush = false);
+		inline unsigned char* getEncodedData() { return encodedBuf; }
+		// pts of the last encoded frame in samples at the codec's rate, counted from the first sample added
+		inline int64_t getPts() const { return pts; }
+
+		inline AVCodecContext* getCodecContext() { return codecCtx; }
+		inline AVStream* getStream() { return stream; }
+
+	private:
+		Logger* logger;
+		AVStream* stream;
+		AVCodec* codec;
+		AVCodecContext* codecCtx;
+		ReSampleContext* resampleCtx;
+		unsigned char* encodedBuf;
+		bool opened;
+
+		int inSampleRate;
+		int numChannels;
+		int frameSize;
+		int64_t samplesEncoded;
+		int64_t pts;
+
+		// all sized in open() so adding samples doesn't allocate in the common case
+		std::vector<short> converted;
+		std::vector<short> resampled;
+		std::vector<short> pending;
+		std::vector<float> floatFrame;
+		int pendingStart;
+		int pendingEnd;
+	};
+}
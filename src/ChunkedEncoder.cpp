@@ -0,0 +1,367 @@
+/*
+ *  ChunkedEncoder.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "ChunkedEncoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace itg
+{
+	EncodedChunk::EncodedChunk(int firstFrame) :
+		firstFrame(firstFrame), numFrames(0), sealed(false), claimed(false), done(false), numBits(0)
+	{
+	}
+
+	EncodedChunk::~EncodedChunk()
+	{
+		for (unsigned i = 0; i < frames.size(); i++) frames[i]->release();
+		for (unsigned i = 0; i < packets.size(); i++) av_free_packet(&packets[i]);
+	}
+
+	ChunkWorker::ChunkWorker(ChunkedEncoder* owner, Logger* logger, ThreadFactory* threads) :
+		owner(owner), logger(logger), threads(threads), muxer(logger), encoder(logger), pixels(NULL), picture(NULL)
+	{
+		const OutputSettings& settings = owner->settings;
+		converter.setup(owner->inFormat, settings.outW, settings.outH, PIX_FMT_YUV420P, SWS_BICUBIC);
+		pixels = (unsigned char*)av_malloc(avpicture_get_size(PIX_FMT_YUV420P, settings.outW, settings.outH));
+		picture = avcodec_alloc_frame();
+		avpicture_fill((AVPicture*)picture, pixels, PIX_FMT_YUV420P, settings.outW, settings.outH);
+	}
+
+	ChunkWorker::~ChunkWorker()
+	{
+		closeEncoder();
+		av_free(picture);
+		av_free(pixels);
+	}
+
+	void ChunkWorker::run()
+	{
+		while (EncodedChunk* chunk = owner->claimChunk())
+		{
+			encodeChunk(chunk);
+			owner->chunkDone(chunk);
+		}
+	}
+
+	void ChunkWorker::encodeChunk(EncodedChunk* chunk)
+	{
+		int bitRate = owner->getChunkBitRate();
+		bool opened = openEncoder(bitRate);
+		if (!opened && bitRate != owner->settings.bitRate)
+		{
+			// some codecs put the rate in the header, start() checked the output's own
+			closeEncoder();
+			opened = openEncoder(owner->settings.bitRate);
+		}
+		if (!opened)
+		{
+			// its frames are still taken off the chunk, the movie just skips them
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open an encoder for frames %d on", chunk->firstFrame);
+			closeEncoder();
+		}
+
+		int64_t pts = 0;
+		while (true)
+		{
+			bool last = false;
+			Frame* frame = owner->popFrame(chunk, last);
+			if (!frame)
+			{
+				if (last || !owner->running) break;
+				threads->sleepMillis(1);
+				continue;
+			}
+			if (opened)
+			{
+				converter.convert(frame->planes, picture);
+				// each chunk counts from 0, it's moved into place when it's written
+				picture->pts = pts;
+				addPacket(chunk, encoder.encode(picture), pts);
+			}
+			pts++;
+			frame->release();
+		}
+
+		if (!opened) return;
+		// frames the codec held back
+		int size;
+		while ((size = encoder.encode(NULL)) > 0) addPacket(chunk, size, pts);
+		closeEncoder();
+	}
+
+	// an encoder set up exactly like the output's, apart from its bit rate
+	bool ChunkWorker::openEncoder(int bitRate)
+	{
+		const OutputSettings& settings = owner->settings;
+		if (!muxer.setup(settings.container, settings.codecId)) return false;
+		AVStream* stream = muxer.addVideoStream();
+		if (!encoder.configure(stream, settings.codecId, settings.outW, settings.outH, bitRate, owner->frameRate, muxer.needsGlobalHeader())) return false;
+		if (!muxer.setParameters()) return false;
+		if (!encoder.open()) return false;
+		// the packets are decoded with the output's header, not this one
+		return owner->matchesHeader(encoder.getCodecContext());
+	}
+
+	void ChunkWorker::closeEncoder()
+	{
+		encoder.close();
+		muxer.close();
+	}
+
+	void ChunkWorker::addPacket(EncodedChunk* chunk, int size, int64_t fallbackPts)
+	{
+		if (size <= 0) return;
+		AVFrame* coded = encoder.getCodecContext()->coded_frame;
+		int64_t pts = coded && coded->pts != (int64_t)AV_NOPTS_VALUE ? coded->pts : fallbackPts;
+
+		AVPacket pkt;
+		av_init_packet(&pkt);
+		pkt.pts = chunk->firstFrame + pts;
+		pkt.dts = pkt.pts;
+		if (coded && coded->key_frame) pkt.flags |= AV_PKT_FLAG_KEY;
+		pkt.data = encoder.getEncodedData();
+		pkt.size = size;
+		// the encoder's buffer is reused for the next frame
+		av_dup_packet(&pkt);
+		chunk->packets.push_back(pkt);
+		chunk->numBits += size * 8;
+	}
+
+	ChunkedEncoder::ChunkedEncoder(Logger* logger, ThreadFactory* threads) :
+		logger(logger),
+		threads(threads),
+		frameRate(25),
+		chunkFrames(0),
+		maxFramesWaiting(0),
+		filling(NULL),
+		numFramesAdded(0),
+		numFramesWaiting(0),
+		bitsWritten(0),
+		framesWritten(0),
+		running(false)
+	{
+		mutex = threads->createMutex();
+	}
+
+	ChunkedEncoder::~ChunkedEncoder()
+	{
+		cancel();
+		delete mutex;
+	}
+
+	bool ChunkedEncoder::start(const FrameFormat& inFormat, const OutputSettings& settings, AVCodecContext* masterCtx, int frameRate, int numWorkers, int chunkFrames)
+	{
+		cancel();
+		this->inFormat = inFormat;
+		this->settings = settings;
+		this->frameRate = frameRate;
+		if (chunkFrames <= 0) chunkFrames = DEFAULT_CHUNK_GOPS * VideoEncoder::GOP_SIZE;
+		// every chunk starts on a keyframe, so keep the GOPs the same length as without chunks
+		this->chunkFrames = (chunkFrames + VideoEncoder::GOP_SIZE - 1) / VideoEncoder::GOP_SIZE * VideoEncoder::GOP_SIZE;
+		if (numWorkers <= 0) numWorkers = getNumCores();
+		// a chunk for each worker and the one being filled
+		maxFramesWaiting = (numWorkers + 1) * this->chunkFrames;
+
+		filling = NULL;
+		numFramesAdded = 0;
+		numFramesWaiting = 0;
+		bitsWritten = 0;
+		framesWritten = 0;
+		header.clear();
+		if (masterCtx->extradata) header.assign(masterCtx->extradata, masterCtx->extradata + masterCtx->extradata_size);
+
+		for (int i = 0; i < numWorkers; i++) workers.push_back(new ChunkWorker(this, logger, threads));
+		// try one before any frames are given to them
+		bool matches = workers[0]->openEncoder(settings.bitRate);
+		workers[0]->closeEncoder();
+		if (!matches)
+		{
+			logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Chunk encoders don't match the output's codec header, encoding the frames in order instead");
+			stopWorkers();
+			return false;
+		}
+
+		running = true;
+		for (int i = 0; i < numWorkers; i++)
+		{
+			workerThreads.push_back(threads->createThread());
+			workerThreads.back()->start(workers[i]);
+		}
+		return true;
+	}
+
+	void ChunkedEncoder::addFrame(Frame* frame)
+	{
+		ScopedLock lock(mutex);
+		if (!running)
+		{
+			frame->release();
+			return;
+		}
+		if (!filling || filling->numFrames == chunkFrames)
+		{
+			if (filling) filling->sealed = true;
+			filling = new EncodedChunk(numFramesAdded);
+			chunks.push_back(filling);
+		}
+		filling->frames.push_back(frame);
+		filling->numFrames++;
+		numFramesAdded++;
+		numFramesWaiting++;
+	}
+
+	void ChunkedEncoder::writeFinished(RecordingOutput* output)
+	{
+		while (true)
+		{
+			EncodedChunk* chunk = NULL;
+			{
+				ScopedLock lock(mutex);
+				if (chunks.empty() || !chunks.front()->done) return;
+				chunk = chunks.front();
+				chunks.pop_front();
+			}
+			for (unsigned i = 0; i < chunk->packets.size(); i++)
+			{
+				output->writeVideoPacket(&chunk->packets[i]);
+			}
+			{
+				ScopedLock lock(mutex);
+				bitsWritten += chunk->numBits;
+				framesWritten += chunk->numFrames;
+			}
+			delete chunk;
+		}
+	}
+
+	void ChunkedEncoder::finish(RecordingOutput* output)
+	{
+		{
+			ScopedLock lock(mutex);
+			if (filling) filling->sealed = true;
+			filling = NULL;
+		}
+		while (true)
+		{
+			writeFinished(output);
+			{
+				ScopedLock lock(mutex);
+				if (chunks.empty()) break;
+			}
+			threads->sleepMillis(1);
+		}
+		stopWorkers();
+	}
+
+	void ChunkedEncoder::cancel()
+	{
+		stopWorkers();
+		for (unsigned i = 0; i < chunks.size(); i++) delete chunks[i];
+		chunks.clear();
+		filling = NULL;
+	}
+
+	int ChunkedEncoder::getNumFramesWaiting()
+	{
+		ScopedLock lock(mutex);
+		return numFramesWaiting;
+	}
+
+// PRIVATE
+
+	EncodedChunk* ChunkedEncoder::claimChunk()
+	{
+		while (running)
+		{
+			{
+				ScopedLock lock(mutex);
+				for (unsigned i = 0; i < chunks.size(); i++)
+				{
+					if (chunks[i]->claimed) continue;
+					chunks[i]->claimed = true;
+					return chunks[i];
+				}
+			}
+			threads->sleepMillis(1);
+		}
+		return NULL;
+	}
+
+	Frame* ChunkedEncoder::popFrame(EncodedChunk* chunk, bool& last)
+	{
+		ScopedLock lock(mutex);
+		last = chunk->sealed && chunk->frames.empty();
+		if (chunk->frames.empty()) return NULL;
+		Frame* frame = chunk->frames.front();
+		chunk->frames.pop_front();
+		numFramesWaiting--;
+		return frame;
+	}
+
+	void ChunkedEncoder::chunkDone(EncodedChunk* chunk)
+	{
+		ScopedLock lock(mutex);
+		chunk->done = true;
+	}
+
+	bool ChunkedEncoder::matchesHeader(AVCodecContext* codecCtx) const
+	{
+		if (codecCtx->extradata_size != (int)header.size()) return false;
+		return header.empty() || memcmp(codecCtx->extradata, &header[0], header.size()) == 0;
+	}
+
+	int ChunkedEncoder::getChunkBitRate()
+	{
+		ScopedLock lock(mutex);
+		if (framesWritten == 0) return settings.bitRate;
+		// spread the difference over the chunks that are about to be encoded
+		int64_t target = (int64_t)settings.bitRate * framesWritten / frameRate;
+		int64_t correction = (target - bitsWritten) * frameRate / ((int64_t)chunkFrames * workers.size());
+		int64_t bitRate = settings.bitRate + correction;
+		return (int)std::max((int64_t)settings.bitRate / 2, std::min((int64_t)settings.bitRate * 2, bitRate));
+	}
+
+	void ChunkedEncoder::stopWorkers()
+	{
+		running = false;
+		for (unsigned i = 0; i < workerThreads.size(); i++)
+		{
+			workerThreads[i]->join();
+			delete workerThreads[i];
+		}
+		// they may not have been started
+		for (unsigned i = 0; i < workers.size(); i++) delete workers[i];
+		workerThreads.clear();
+		workers.clear();
+	}
+}
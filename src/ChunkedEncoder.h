@@ -0,0 +1,170 @@
+/*
+ *  ChunkedEncoder.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+#include "FrameConverter.h"
+#include "VideoEncoder.h"
+#include "Muxer.h"
+#include "RecordingOutput.h"
+
+namespace itg
+{
+	class ChunkedEncoder;
+
+	// a run of consecutive frames encoded by one encoder instance, starting on a keyframe
+	struct EncodedChunk
+	{
+		EncodedChunk(int firstFrame);
+		~EncodedChunk();
+
+		// of the whole recording
+		int firstFrame;
+		// captured frames waiting for the worker, guarded by the encoder's mutex
+		std::deque<Frame*> frames;
+		int numFrames;
+		// no more frames are coming
+		bool sealed;
+		bool claimed;
+		volatile bool done;
+		// pts and dts in frames from the start of the recording
+		std::vector<AVPacket> packets;
+		int64_t numBits;
+	};
+
+	// converts and encodes the chunks it's given with an encoder of its own
+	class ChunkWorker : public Runnable
+	{
+	public:
+		ChunkWorker(ChunkedEncoder* owner, Logger* logger, ThreadFactory* threads);
+		~ChunkWorker();
+
+		void run();
+
+		// false if it won't open or its global header isn't the output's
+		bool openEncoder(int bitRate);
+		void closeEncoder();
+
+	private:
+		void encodeChunk(EncodedChunk* chunk);
+		void addPacket(EncodedChunk* chunk, int size, int64_t fallbackPts);
+
+		ChunkedEncoder* owner;
+		Logger* logger;
+		ThreadFactory* threads;
+		// only holds the stream the encoder's context belongs to, never opened
+		Muxer muxer;
+		VideoEncoder encoder;
+		FrameConverter converter;
+		unsigned char* pixels;
+		AVFrame* picture;
+	};
+
+	// for offline renders, where one encoder is the bottleneck even with codec threads.
+	// Frames are split into chunks of whole GOPs, each chunk is converted and encoded by
+	// its own encoder instance on a pool of workers, and the finished chunks' packets are
+	// written into the output's container in order, as they are, without re-encoding.
+	// Each chunk restarts rate control, so the bit rate of the chunks still to be started
+	// is corrected by however far the finished ones were over or under the target
+	class ChunkedEncoder
+	{
+	public:
+		// chunks are this many GOPs unless set otherwise
+		static const int DEFAULT_CHUNK_GOPS = 5;
+
+		ChunkedEncoder(Logger* logger, ThreadFactory* threads);
+		// stops the workers, call finish() first to keep what they encoded
+		~ChunkedEncoder();
+
+		// settings have to match the output's own encoder so the chunks' packets can go
+		// into its container.  numWorkers 0 for one per core, chunkFrames is rounded up
+		// to whole GOPs, 0 for DEFAULT_CHUNK_GOPS.  False if the chunks' encoders wouldn't
+		// give the same global header as masterCtx, already written to the container
+		bool start(const FrameFormat& inFormat, const OutputSettings& settings, AVCodecContext* masterCtx, int frameRate, int numWorkers, int chunkFrames);
+		// takes over the caller's reference, frames must be added in order
+		void addFrame(Frame* frame);
+		// write the packets of the chunks that are done, in order, returns straight away
+		void writeFinished(RecordingOutput* output);
+		// encode what's left, write it and stop the workers
+		void finish(RecordingOutput* output);
+		// stop without writing anything
+		void cancel();
+
+		// frames added and not yet encoded, the capture should wait once this gets to getMaxFramesWaiting()
+		int getNumFramesWaiting();
+		inline int getMaxFramesWaiting() const { return maxFramesWaiting; }
+		inline bool isRunning() const { return running; }
+
+	private:
+		friend class ChunkWorker;
+
+		// for the workers, the oldest chunk nobody is encoding, waits for one, NULL once stopped
+		EncodedChunk* claimChunk();
+		// the chunk's next frame, NULL if there isn't one yet or, with last set, ever
+		Frame* popFrame(EncodedChunk* chunk, bool& last);
+		void chunkDone(EncodedChunk* chunk);
+		// the chunk encoder's extradata is the same as the output's
+		bool matchesHeader(AVCodecContext* codecCtx) const;
+		// the bit rate for the next chunk, corrected by what's been written so far
+		int getChunkBitRate();
+		void stopWorkers();
+
+		Logger* logger;
+		ThreadFactory* threads;
+		FrameFormat inFormat;
+		OutputSettings settings;
+		int frameRate;
+		int chunkFrames;
+		int maxFramesWaiting;
+		// the output stream's extradata, empty without a global header
+		std::vector<unsigned char> header;
+
+		Mutex* mutex;
+		// in order, the front one is written first
+		std::deque<EncodedChunk*> chunks;
+		EncodedChunk* filling;
+		int numFramesAdded;
+		int numFramesWaiting;
+		// of the chunks written so far
+		int64_t bitsWritten;
+		int framesWritten;
+
+		std::vector<ChunkWorker*> workers;
+		std::vector<Thread*> workerThreads;
+		volatile bool running;
+	};
+}
@@ -0,0 +1,274 @@
+/*
+ *  ExporterPlatform.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "ExporterPlatform.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <sys/time.h>
+	#include <unistd.h>
+#endif
+
+namespace itg
+{
+	void Logger::log(ExporterLogLevel level, const char* format, ...)
+	{
+		char buf[1024];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		write(level, buf);
+	}
+
+#ifdef _WIN32
+	class SystemClock : public Clock
+	{
+	public:
+		SystemClock()
+		{
+			QueryPerformanceFrequency(&freq);
+			QueryPerformanceCounter(&start);
+		}
+
+		float getElapsedTimef()
+		{
+			LARGE_INTEGER now;
+			QueryPerformanceCounter(&now);
+			return (float)((double)(now.QuadPart - start.QuadPart) / (double)freq.QuadPart);
+		}
+
+	private:
+		LARGE_INTEGER freq;
+		LARGE_INTEGER start;
+	};
+
+	class NativeMutex : public Mutex
+	{
+	public:
+		NativeMutex() { InitializeCriticalSection(&cs); }
+		~NativeMutex() { DeleteCriticalSection(&cs); }
+		void lock() { EnterCriticalSection(&cs); }
+		void unlock() { LeaveCriticalSection(&cs); }
+
+	private:
+		CRITICAL_SECTION cs;
+	};
+
+	class NativeThread : public Thread
+	{
+	public:
+		NativeThread() : handle(NULL) {}
+		~NativeThread() { join(); }
+
+		void start(Runnable* runnable)
+		{
+			join();
+			handle = CreateThread(NULL, 0, &NativeThread::entry, runnable, 0, NULL);
+		}
+
+		void join()
+		{
+			if (handle)
+			{
+				WaitForSingleObject(handle, INFINITE);
+				CloseHandle(handle);
+				handle = NULL;
+			}
+		}
+
+	private:
+		static DWORD WINAPI entry(LPVOID arg)
+		{
+			((Runnable*)arg)->run();
+			return 0;
+		}
+
+		HANDLE handle;
+	};
+#else
+	class SystemClock : public Clock
+	{
+	public:
+		SystemClock() { gettimeofday(&start, NULL); }
+
+		float getElapsedTimef()
+		{
+			timeval now;
+			gettimeofday(&now, NULL);
+			return (float)(now.tv_sec - start.tv_sec) + 1e-6f * (float)(now.tv_usec - start.tv_usec);
+		}
+
+	private:
+		timeval start;
+	};
+
+	class NativeMutex : public Mutex
+	{
+	public:
+		NativeMutex() { pthread_mutex_init(&mutex, NULL); }
+		~NativeMutex() { pthread_mutex_destroy(&mutex); }
+		void lock() { pthread_mutex_lock(&mutex); }
+		void unlock() { pthread_mutex_unlock(&mutex); }
+
+	private:
+		pthread_mutex_t mutex;
+	};
+
+	class NativeThread : public Thread
+	{
+	public:
+		NativeThread() : started(false) {}
+		~NativeThread() { join(); }
+
+		void start(Runnable* runnable)
+		{
+			join();
+			started = pthread_create(&thread, NULL, &NativeThread::entry, runnable) == 0;
+		}
+
+		void join()
+		{
+			if (started)
+			{
+				pthread_join(thread, NULL);
+				started = false;
+			}
+		}
+
+	private:
+		static void* entry(void* arg)
+		{
+			((Runnable*)arg)->run();
+			return NULL;
+		}
+
+		pthread_t thread;
+		bool started;
+	};
+#endif
+
+	class StdErrLogger : public Logger
+	{
+	protected:
+		void write(ExporterLogLevel level, const std::string& message)
+		{
+			static const char* names[] = { "verbose", "notice", "warning", "error" };
+			fprintf(stderr, "[%s] %s\n", names[level], message.c_str());
+		}
+	};
+
+	class NativeThreadFactory : public ThreadFactory
+	{
+	public:
+		Mutex* createMutex() { return new NativeMutex(); }
+		Thread* createThread() { return new NativeThread(); }
+		void sleepMillis(int millis)
+		{
+#ifdef _WIN32
+			Sleep(millis);
+#else
+			usleep(millis * 1000);
+#endif
+		}
+	};
+
+	int atomicIncrement(volatile int* value)
+	{
+#ifdef _WIN32
+		return InterlockedIncrement((volatile LONG*)value);
+#else
+		return __sync_add_and_fetch(value, 1);
+#endif
+	}
+
+	int atomicDecrement(volatile int* value)
+	{
+#ifdef _WIN32
+		return InterlockedDecrement((volatile LONG*)value);
+#else
+		return __sync_sub_and_fetch(value, 1);
+#endif
+	}
+
+	void memoryBarrier()
+	{
+#ifdef _WIN32
+		MemoryBarrier();
+#else
+		__sync_synchronize();
+#endif
+	}
+
+	int getNumCores()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		int numCores = info.dwNumberOfProcessors;
+#else
+		int numCores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		return numCores > 0 ? numCores : 1;
+	}
+
+	bool replaceFile(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	Clock* getDefaultClock()
+	{
+		static SystemClock clock;
+		return &clock;
+	}
+
+	Logger* getDefaultLogger()
+	{
+		static StdErrLogger logger;
+		return &logger;
+	}
+
+	ThreadFactory* getDefaultThreadFactory()
+	{
+		static NativeThreadFactory factory;
+		return &factory;
+	}
+}
@@ -0,0 +1,130 @@
+/*
+ *  ExporterPlatform.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+// encode on a thread per recording, comment out to encode in addFrame().  Defined here
+// so every class of the core sees the same setting
+#define _THREAD_CAPTURE
+
+#include <string>
+
+// the encoder core doesn't know about openFrameworks, anything it needs
+// from the outside world (time, logging, threads) comes through these
+namespace itg
+{
+	enum ExporterLogLevel
+	{
+		EXPORTER_LOG_VERBOSE,
+		EXPORTER_LOG_NOTICE,
+		EXPORTER_LOG_WARNING,
+		EXPORTER_LOG_ERROR
+	};
+
+	class Clock
+	{
+	public:
+		virtual ~Clock() {}
+		// seconds since some fixed point, only differences are used
+		virtual float getElapsedTimef() = 0;
+	};
+
+	class Logger
+	{
+	public:
+		virtual ~Logger() {}
+		// printf style
+		void log(ExporterLogLevel level, const char* format, ...);
+
+	protected:
+		virtual void write(ExporterLogLevel level, const std::string& message) = 0;
+	};
+
+	class Mutex
+	{
+	public:
+		virtual ~Mutex() {}
+		virtual void lock() = 0;
+		virtual void unlock() = 0;
+	};
+
+	class ScopedLock
+	{
+	public:
+		ScopedLock(Mutex* mutex) : mutex(mutex) { mutex->lock(); }
+		~ScopedLock() { mutex->unlock(); }
+
+	private:
+		Mutex* mutex;
+	};
+
+	class Runnable
+	{
+	public:
+		virtual ~Runnable() {}
+		virtual void run() = 0;
+	};
+
+	class Thread
+	{
+	public:
+		virtual ~Thread() {}
+		// calls runnable->run() on a new thread, the thread ends when run() returns
+		virtual void start(Runnable* runnable) = 0;
+		// block until run() has returned, safe to call if never started
+		virtual void join() = 0;
+	};
+
+	class ThreadFactory
+	{
+	public:
+		virtual ~ThreadFactory() {}
+		// caller owns the returned objects
+		virtual Mutex* createMutex() = 0;
+		virtual Thread* createThread() = 0;
+		virtual void sleepMillis(int millis) = 0;
+	};
+
+	// returns the new value, for reference counts shared between threads
+	int atomicIncrement(volatile int* value);
+	int atomicDecrement(volatile int* value);
+	// full fence, for lock free structures shared between two threads
+	void memoryBarrier();
+	// processors available to this process, at least 1
+	int getNumCores();
+	// rename from over to in one step, readers of to see either the old or the new file
+	bool replaceFile(const std::string& from, const std::string& to);
+
+	// plain OS implementations (pthreads or win32), used when nothing is injected
+	Clock* getDefaultClock();
+	Logger* getDefaultLogger();
+	ThreadFactory* getDefaultThreadFactory();
+}
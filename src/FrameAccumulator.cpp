@@ -0,0 +1,271 @@
+/*
+ *  FrameAccumulator.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "FrameAccumulator.h"
+
+#include <algorithm>
+
+extern "C"
+{
+	#include <pixdesc.h>
+}
+
+namespace itg
+{
+	// plain loops over 16 bit lanes, simple enough for the compiler to vectorise
+	static void addBytes(const unsigned char* pixels, uint16_t* sums, int count)
+	{
+		for (int i = 0; i < count; i++) sums[i] += pixels[i];
+	}
+
+	// sums * reciprocal >> 16 rather than a divide per byte
+	static void averageBytes(const uint16_t* sums, unsigned char* pixels, int count, uint32_t reciprocal)
+	{
+		for (int i = 0; i < count; i++) pixels[i] = (unsigned char)((sums[i] * reciprocal + 0x8000) >> 16);
+	}
+
+	static void addRow(const uint16_t* sums, uint32_t* rowSums, int count)
+	{
+		for (int i = 0; i < count; i++) rowSums[i] += sums[i];
+	}
+
+	// bytes per pixel in a plane, pairs of pixels for packed 4:2:2
+	static int getPixelStep(const FrameFormat& format, int plane)
+	{
+		const AVPixFmtDescriptor& desc = av_pix_fmt_descriptors[format.pixelFormat];
+		int step = 1;
+		for (int i = 0; i < desc.nb_components; i++)
+		{
+			if (desc.comp[i].plane == plane) step = std::max(step, desc.comp[i].step_minus1 + 1);
+		}
+		return step;
+	}
+
+	FrameAccumulator::FrameAccumulator(Logger* logger, ThreadFactory* threads) :
+#ifdef _THREAD_CAPTURE
+		thread(NULL),
+#endif
+		logger(logger),
+		threads(threads),
+		pool(NULL),
+		running(false),
+		input(threads),
+		output(threads),
+		stride(1),
+		downscale(1),
+		step(1),
+		numFrames(0),
+		numSummed(0)
+	{
+#ifdef _THREAD_CAPTURE
+		thread = threads->createThread();
+#endif
+	}
+
+	FrameAccumulator::~FrameAccumulator()
+	{
+		stop();
+		while (Frame* frame = output.pop()) frame->release();
+#ifdef _THREAD_CAPTURE
+		delete thread;
+#endif
+	}
+
+	bool FrameAccumulator::canAccumulate(const FrameFormat& format)
+	{
+		const AVPixFmtDescriptor& desc = av_pix_fmt_descriptors[format.pixelFormat];
+		if (desc.flags & (PIX_FMT_BITSTREAM | PIX_FMT_PAL)) return false;
+		for (int i = 0; i < desc.nb_components; i++)
+		{
+			if (desc.comp[i].depth_minus1 != 7) return false;
+		}
+		return true;
+	}
+
+	bool FrameAccumulator::canDownscale(const FrameFormat& format, int downscale)
+	{
+		if (downscale < 1 || downscale > MAX_DOWNSCALE) return false;
+		// whole pixel pairs for 4:2:x chroma and packed 4:2:2 after scaling too
+		return format.width % (2 * downscale) == 0 && format.height % (2 * downscale) == 0;
+	}
+
+	FrameFormat FrameAccumulator::getDownscaledFormat(const FrameFormat& format, int downscale)
+	{
+		if (downscale <= 1) return format;
+		return FrameFormat(format.width / downscale, format.height / downscale, format.pixelFormat, 0, format.bottomUp);
+	}
+
+	void FrameAccumulator::start(const FrameFormat& inFormat, FrameQueue* pool, int stride, int downscale)
+	{
+		stop();
+		this->inFormat = inFormat;
+		this->pool = pool;
+		this->stride = std::max(stride, 1);
+		this->downscale = std::max(downscale, 1);
+		step = (this->stride + MAX_SUMMED_FRAMES - 1) / MAX_SUMMED_FRAMES;
+		numFrames = 0;
+		numSummed = 0;
+		sums.assign(inFormat.getSize(), 0);
+		running = true;
+#ifdef _THREAD_CAPTURE
+		thread->start(this);
+#endif
+	}
+
+	void FrameAccumulator::stop()
+	{
+		running = false;
+#ifdef _THREAD_CAPTURE
+		thread->join();
+#endif
+		// anything added after the thread saw it was stopping
+		while (Frame* frame = input.pop())
+		{
+			accumulate(frame);
+			frame->release();
+		}
+	}
+
+	void FrameAccumulator::addFrame(Frame* frame)
+	{
+		if (!running)
+		{
+			frame->release();
+			return;
+		}
+#ifdef _THREAD_CAPTURE
+		input.push(frame);
+#else
+		accumulate(frame);
+		frame->release();
+#endif
+	}
+
+	Frame* FrameAccumulator::popAveraged()
+	{
+		return output.pop();
+	}
+
+// PRIVATE
+
+#ifdef _THREAD_CAPTURE
+	void FrameAccumulator::run()
+	{
+		while (true)
+		{
+			// running is cleared after the last frame is queued so read it before popping
+			bool stopping = !running;
+			memoryBarrier();
+			Frame* frame = input.pop();
+			if (frame)
+			{
+				accumulate(frame);
+				frame->release();
+			}
+			else if (stopping) break;
+			else threads->sleepMillis(1);
+		}
+	}
+#endif
+
+	void FrameAccumulator::accumulate(Frame* frame)
+	{
+		if (numFrames % step == 0)
+		{
+			// planes of app frames aren't necessarily one after the other, the sums are
+			uint16_t* planeSums = &sums[0];
+			for (int i = 0; i < inFormat.getNumPlanes(); i++)
+			{
+				addBytes(frame->planes[i], planeSums, inFormat.getPlaneSize(i));
+				planeSums += inFormat.getPlaneSize(i);
+			}
+			numSummed++;
+		}
+		numFrames++;
+		if (numFrames == stride) emitAverage(frame->time);
+	}
+
+	void FrameAccumulator::emitAverage(float time)
+	{
+		Frame* frame = pool->acquire();
+		if (downscale > 1)
+		{
+			// 32 bit fraction, a 16 bit one isn't precise enough for up to 16 x 257 samples
+			int numSamples = numSummed * downscale * downscale;
+			emitDownscaled(frame, (uint32_t)((0x100000000ull + numSamples / 2) / numSamples));
+		}
+		else
+		{
+			// numSummed is at least 1, so the reciprocal fits 17 bits and sum * reciprocal 32
+			uint32_t reciprocal = (0x10000 + numSummed / 2) / numSummed;
+			averageBytes(&sums[0], frame->pixels, sums.size(), reciprocal);
+		}
+		frame->time = time;
+		output.push(frame);
+
+		std::fill(sums.begin(), sums.end(), 0);
+		numFrames = 0;
+		numSummed = 0;
+	}
+
+	void FrameAccumulator::emitDownscaled(Frame* frame, uint32_t reciprocal)
+	{
+		const FrameFormat& outFormat = pool->getFormat();
+		const uint16_t* planeSums = &sums[0];
+		for (int i = 0; i < inFormat.getNumPlanes(); i++)
+		{
+			int pixelStep = getPixelStep(inFormat, i);
+			int outPixels = outFormat.getRowBytes(i) / pixelStep;
+			int rowBytes = outPixels * downscale * pixelStep;
+			int sumStride = inFormat.strides[i];
+			rowSums.resize(rowBytes);
+			for (int y = 0; y < outFormat.getPlaneHeight(i); y++)
+			{
+				// whole rows down first so that part vectorises, then across each block
+				std::fill(rowSums.begin(), rowSums.end(), 0);
+				const uint16_t* rows = planeSums + y * downscale * sumStride;
+				for (int dy = 0; dy < downscale; dy++) addRow(rows + dy * sumStride, &rowSums[0], rowBytes);
+
+				unsigned char* out = frame->planes[i] + y * outFormat.strides[i];
+				for (int x = 0; x < outPixels; x++)
+				{
+					for (int c = 0; c < pixelStep; c++)
+					{
+						uint64_t sum = 0;
+						for (int dx = 0; dx < downscale; dx++) sum += rowSums[(x * downscale + dx) * pixelStep + c];
+						out[x * pixelStep + c] = (unsigned char)((sum * reciprocal + 0x80000000u) >> 32);
+					}
+				}
+			}
+			planeSums += inFormat.getPlaneSize(i);
+		}
+	}
+}
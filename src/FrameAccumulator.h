@@ -0,0 +1,108 @@
+/*
+ *  FrameAccumulator.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+
+namespace itg
+{
+	// averages every stride captured frames into one, for time-lapses that blur motion
+	// between the frames they keep rather than alias it and for motion blurred renders.
+	// Frames are summed into 16 bit totals on a thread of its own, so memory and time per
+	// frame are the same whatever the stride.  Works on the frames' bytes as they are, so
+	// any format with 8 bit components, packed or planar, is averaged without converting
+	// it first.  Supersampled frames can be box filtered down as they're averaged
+	class FrameAccumulator
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		// 255 * 257 still fits 16 bits, longer strides only sum every n'th frame
+		static const int MAX_SUMMED_FRAMES = 257;
+		static const int MAX_DOWNSCALE = 4;
+
+		FrameAccumulator(Logger* logger, ThreadFactory* threads);
+		~FrameAccumulator();
+
+		// formats with anything other than 8 bit components can't be averaged byte by byte
+		static bool canAccumulate(const FrameFormat& format);
+		// the size has to divide into whole chroma samples, format averaged downscale times smaller
+		static bool canDownscale(const FrameFormat& format, int downscale);
+		static FrameFormat getDownscaledFormat(const FrameFormat& format, int downscale);
+
+		// frames added are in inFormat, averages go into buffers from pool, which has to hold
+		// frames of getDownscaledFormat(inFormat, downscale)
+		void start(const FrameFormat& inFormat, FrameQueue* pool, int stride, int downscale = 1);
+		// averages whatever has been added, a stride that isn't complete is dropped
+		void stop();
+		inline bool isRunning() const { return running; }
+
+		// takes over the caller's reference
+		void addFrame(Frame* frame);
+		// the next finished average with one reference for the caller, NULL if there isn't one
+		Frame* popAveraged();
+
+	private:
+#ifdef _THREAD_CAPTURE
+		void run();
+		Thread* thread;
+#endif
+		void accumulate(Frame* frame);
+		void emitAverage(float time);
+		void emitDownscaled(Frame* frame, uint32_t reciprocal);
+
+		Logger* logger;
+		ThreadFactory* threads;
+		FrameFormat inFormat;
+		FrameQueue* pool;
+		volatile bool running;
+
+		// only used as queues, the frames belong to the exporter's pool or the app
+		FrameQueue input;
+		FrameQueue output;
+
+		std::vector<uint16_t> sums;
+		// vertical sums of the rows of one output row when downscaling
+		std::vector<uint32_t> rowSums;
+		int stride;
+		int downscale;
+		// frames of the stride that are summed, the rest are skipped
+		int step;
+		// frames of the current stride seen and summed so far
+		int numFrames;
+		int numSummed;
+	};
+}
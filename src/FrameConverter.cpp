@@ -0,0 +1,137 @@
+/*
+ *  FrameConverter.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "FrameConverter.h"
+
+extern "C"
+{
+	#include <imgutils.h>
+}
+
+namespace itg
+{
+	FrameConverter::FrameConverter() :
+		convertCtx(NULL),
+		bandCtx(NULL),
+		tailCtx(NULL),
+		bandRows(0),
+		flags(SWS_BICUBIC)
+	{
+	}
+
+	FrameConverter::~FrameConverter()
+	{
+		clear();
+	}
+
+	void FrameConverter::setup(const FrameFormat& inFormat, int outW, int outH, PixelFormat outFormat, int flags)
+	{
+		clear();
+		this->inFormat = inFormat;
+		this->outFormat = FrameFormat(outW, outH, outFormat);
+		this->flags = flags;
+		convertCtx = sws_getContext(inFormat.width, inFormat.height, inFormat.pixelFormat, outW, outH, outFormat, flags, NULL, NULL, NULL);
+	}
+
+	void FrameConverter::setFlags(int flags)
+	{
+		if (flags == this->flags || !convertCtx) return;
+		setup(inFormat, outFormat.width, outFormat.height, outFormat.pixelFormat, flags);
+	}
+
+	void FrameConverter::clear()
+	{
+		if (convertCtx) sws_freeContext(convertCtx);
+		if (bandCtx) sws_freeContext(bandCtx);
+		if (tailCtx) sws_freeContext(tailCtx);
+		convertCtx = NULL;
+		bandCtx = NULL;
+		tailCtx = NULL;
+		bandRows = 0;
+	}
+
+	void FrameConverter::convert(unsigned char* const planes[], AVFrame* outFrame)
+	{
+		const uint8_t* data[FrameFormat::MAX_PLANES];
+		int linesize[FrameFormat::MAX_PLANES];
+		getSource(planes, 0, data, linesize);
+
+		if (isPassthrough())
+		{
+			av_image_copy(outFrame->data, outFrame->linesize, data, linesize, inFormat.pixelFormat, inFormat.width, inFormat.height);
+			return;
+		}
+
+		//perform the conversion to YUV and size
+		sws_scale(convertCtx, data, linesize, 0, inFormat.height, outFrame->data, outFrame->linesize);
+	}
+
+	void FrameConverter::convertRows(unsigned char* const planes[], AVFrame* outFrame, int y, int numRows)
+	{
+		// each band is converted as a picture of its own, swscale only takes slices in order
+		if (bandRows == 0) bandRows = numRows;
+		SwsContext*& ctx = numRows == bandRows ? bandCtx : tailCtx;
+		ctx = sws_getCachedContext(ctx, inFormat.width, numRows, inFormat.pixelFormat,
+			outFormat.width, numRows, outFormat.pixelFormat, flags, NULL, NULL, NULL);
+
+		const uint8_t* data[FrameFormat::MAX_PLANES];
+		int linesize[FrameFormat::MAX_PLANES];
+		getSource(planes, y, data, linesize);
+
+		uint8_t* outData[FrameFormat::MAX_PLANES];
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++)
+		{
+			outData[i] = outFrame->data[i] ? outFrame->data[i] + outFrame->linesize[i] * outFormat.getPlaneRow(i, y) : NULL;
+		}
+		sws_scale(ctx, data, linesize, 0, numRows, outData, outFrame->linesize);
+	}
+
+	// point at image row y of each plane
+	void FrameConverter::getSource(unsigned char* const planes[], int y, const uint8_t* data[], int linesize[])
+	{
+		int numPlanes = inFormat.getNumPlanes();
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++)
+		{
+			data[i] = i < numPlanes ? planes[i] : NULL;
+			linesize[i] = i < numPlanes ? inFormat.strides[i] : 0;
+			if (i >= numPlanes) continue;
+
+			int row = inFormat.getPlaneRow(i, y);
+			// intentionally flip the image to compensate for OF flipping if reading from the screen
+			if (inFormat.bottomUp)
+			{
+				data[i] += linesize[i] * (inFormat.getPlaneHeight(i) - 1 - row);
+				linesize[i] = -linesize[i];
+			}
+			else data[i] += linesize[i] * row;
+		}
+	}
+}
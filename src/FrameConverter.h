@@ -0,0 +1,83 @@
+/*
+ *  FrameConverter.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include "LibAv.h"
+#include "FrameFormat.h"
+
+namespace itg
+{
+	// colour space conversion and scaling of captured frames into the encoder's format
+	class FrameConverter
+	{
+	public:
+		FrameConverter();
+		~FrameConverter();
+
+		// swscale picks its own optimised path for each input format, strides and
+		// orientation are handled by pointing it at the rows rather than repacking
+		void setup(const FrameFormat& inFormat, int outW, int outH, PixelFormat outFormat, int flags = SWS_BICUBIC);
+		void clear();
+		// swap the scaling algorithm, between frames
+		void setFlags(int flags);
+		inline int getFlags() const { return flags; }
+
+		// convert one frame laid out as inFormat into outFrame, which must already point at outW x outH of memory
+		void convert(unsigned char* const planes[], AVFrame* outFrame);
+		// frames already in the output format and size, e.g. decoded YUV, are just copied
+		inline bool isPassthrough() const { return inFormat.pixelFormat == outFormat.pixelFormat && inFormat.width == outFormat.width && inFormat.height == outFormat.height && !inFormat.bottomUp; }
+
+		// only possible without scaling, convert image rows [y, y + numRows) and leave the rest
+		// of outFrame as it was.  y and numRows should be even for subsampled chroma, and calls
+		// should stick to one or two row counts as a scaler is kept for each
+		inline bool canConvertRows() const { return inFormat.width == outFormat.width && inFormat.height == outFormat.height; }
+		void convertRows(unsigned char* const planes[], AVFrame* outFrame, int y, int numRows);
+
+		inline const FrameFormat& getInFormat() const { return inFormat; }
+		inline int getInWidth() const { return inFormat.width; }
+		inline int getInHeight() const { return inFormat.height; }
+		inline int getOutWidth() const { return outFormat.width; }
+		inline int getOutHeight() const { return outFormat.height; }
+
+	private:
+		void getSource(unsigned char* const planes[], int y, const uint8_t* data[], int linesize[]);
+
+		SwsContext* convertCtx;
+		// for convertRows(), the full height bands and the shorter band at the bottom
+		SwsContext* bandCtx;
+		SwsContext* tailCtx;
+		int bandRows;
+		int flags;
+		FrameFormat inFormat;
+		FrameFormat outFormat;
+	};
+}
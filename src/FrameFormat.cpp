@@ -0,0 +1,131 @@
+/*
+ *  FrameFormat.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "FrameFormat.h"
+
+#include <cstring>
+
+extern "C"
+{
+	#include <imgutils.h>
+	#include <pixdesc.h>
+}
+
+namespace itg
+{
+	FrameFormat::FrameFormat() :
+		pixelFormat(PIX_FMT_RGB24), width(0), height(0), bottomUp(false)
+	{
+		for (int i = 0; i < MAX_PLANES; i++) strides[i] = 0;
+	}
+
+	FrameFormat::FrameFormat(int width, int height, PixelFormat pixelFormat, int stride, bool bottomUp) :
+		pixelFormat(pixelFormat), width(width), height(height), bottomUp(bottomUp)
+	{
+		for (int i = 0; i < MAX_PLANES; i++) strides[i] = 0;
+		av_image_fill_linesizes(strides, pixelFormat, width);
+		if (stride > 0) strides[0] = stride;
+	}
+
+	void FrameFormat::setStride(int plane, int stride)
+	{
+		strides[plane] = stride;
+	}
+
+	int FrameFormat::getNumPlanes() const
+	{
+		int numPlanes = 0;
+		while (numPlanes < MAX_PLANES && strides[numPlanes] > 0) numPlanes++;
+		return numPlanes;
+	}
+
+	int FrameFormat::getPlaneHeight(int plane) const
+	{
+		// the chroma planes of subsampled formats are shorter
+		if (plane == 1 || plane == 2) return -((-height) >> av_pix_fmt_descriptors[pixelFormat].log2_chroma_h);
+		return height;
+	}
+
+	int FrameFormat::getRowBytes(int plane) const
+	{
+		return av_image_get_linesize(pixelFormat, width, plane);
+	}
+
+	int FrameFormat::getPlaneRow(int plane, int y) const
+	{
+		if (height <= 0) return 0;
+		return (int)((int64_t)y * getPlaneHeight(plane) / height);
+	}
+
+	int FrameFormat::getSize() const
+	{
+		int size = 0;
+		for (int i = 0; i < getNumPlanes(); i++) size += getPlaneSize(i);
+		return size;
+	}
+
+	void FrameFormat::fillPlanes(unsigned char* pixels, unsigned char* planes[MAX_PLANES]) const
+	{
+		int numPlanes = getNumPlanes();
+		for (int i = 0; i < MAX_PLANES; i++)
+		{
+			planes[i] = i < numPlanes ? pixels : NULL;
+			if (i < numPlanes) pixels += getPlaneSize(i);
+		}
+	}
+
+	void FrameFormat::copyRows(const unsigned char* const src[], unsigned char* const dst[], int y, int numRows) const
+	{
+		for (int i = 0; i < getNumPlanes(); i++)
+		{
+			int planeHeight = getPlaneHeight(i);
+			int first = getPlaneRow(i, y);
+			int end = y + numRows >= height ? planeHeight : getPlaneRow(i, y + numRows);
+			if (bottomUp)
+			{
+				int flippedFirst = planeHeight - end;
+				end = planeHeight - first;
+				first = flippedFirst;
+			}
+			memcpy(dst[i] + first * strides[i], src[i] + first * strides[i], (end - first) * strides[i]);
+		}
+	}
+
+	bool FrameFormat::operator==(const FrameFormat& other) const
+	{
+		if (pixelFormat != other.pixelFormat || width != other.width || height != other.height || bottomUp != other.bottomUp) return false;
+		for (int i = 0; i < MAX_PLANES; i++)
+		{
+			if (strides[i] != other.strides[i]) return false;
+		}
+		return true;
+	}
+}
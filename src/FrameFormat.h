@@ -0,0 +1,76 @@
+/*
+ *  FrameFormat.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include "LibAv.h"
+
+namespace itg
+{
+	// describes how the frames going into the exporter are laid out in memory,
+	// the converter reads them like this directly so they only get touched once
+	class FrameFormat
+	{
+	public:
+		static const int MAX_PLANES = 4;
+
+		FrameFormat();
+		// stride is the bytes per row of the first plane, 0 for tightly packed rows,
+		// set the strides of any other planes with setStride()
+		FrameFormat(int width, int height, PixelFormat pixelFormat = PIX_FMT_RGB24, int stride = 0, bool bottomUp = false);
+
+		void setStride(int plane, int stride);
+
+		int getNumPlanes() const;
+		int getPlaneHeight(int plane) const;
+		inline int getPlaneSize(int plane) const { return strides[plane] * getPlaneHeight(plane); }
+		// bytes of actual pixels in a row of the plane, without any padding
+		int getRowBytes(int plane) const;
+		// row of the plane that holds image row y, for subsampled chroma planes
+		int getPlaneRow(int plane, int y) const;
+		// bytes for all planes stored one after the other
+		int getSize() const;
+		// point planes at the consecutive planes of a buffer of getSize() bytes
+		void fillPlanes(unsigned char* pixels, unsigned char* planes[MAX_PLANES]) const;
+		// copy image rows [y, y + numRows) of every plane between two frames of this format
+		void copyRows(const unsigned char* const src[], unsigned char* const dst[], int y, int numRows) const;
+
+		bool operator==(const FrameFormat& other) const;
+		inline bool operator!=(const FrameFormat& other) const { return !(*this == other); }
+
+		PixelFormat pixelFormat;
+		int width;
+		int height;
+		int strides[MAX_PLANES];
+		// rows are stored bottom first, like glReadPixels gives us
+		bool bottomUp;
+	};
+}
@@ -0,0 +1,79 @@
+/*
+ *  FrameHash.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "FrameHash.h"
+
+#include <cstring>
+
+namespace itg
+{
+	static const uint64_t HASH_PRIME = 0x100000001b3ULL;
+	static const uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+	static const int HASH_LANES = 4;
+
+	// FNV style multiply/xor on 64 bit words, four independent lanes so the
+	// multiplies overlap (and the compiler can vectorise the loop)
+	static void hashRow(const unsigned char* row, int bytes, uint64_t lanes[HASH_LANES])
+	{
+		int i = 0;
+		for (; i + 8 * HASH_LANES <= bytes; i += 8 * HASH_LANES)
+		{
+			uint64_t words[HASH_LANES];
+			memcpy(words, row + i, sizeof(words));
+			for (int j = 0; j < HASH_LANES; j++) lanes[j] = (lanes[j] ^ words[j]) * HASH_PRIME;
+		}
+		for (; i < bytes; i++) lanes[0] = (lanes[0] ^ row[i]) * HASH_PRIME;
+	}
+
+	uint64_t hashFrame(const FrameFormat& format, const unsigned char* const planes[])
+	{
+		uint64_t lanes[HASH_LANES];
+		for (int j = 0; j < HASH_LANES; j++) lanes[j] = HASH_SEED + j;
+
+		for (int plane = 0; plane < format.getNumPlanes(); plane++)
+		{
+			int rowBytes = format.getRowBytes(plane);
+			int height = format.getPlaneHeight(plane);
+			for (int y = 0; y < height; y++)
+			{
+				hashRow(planes[plane] + y * format.strides[plane], rowBytes, lanes);
+			}
+		}
+
+		uint64_t hash = HASH_SEED;
+		for (int j = 0; j < HASH_LANES; j++)
+		{
+			hash = (hash ^ lanes[j]) * HASH_PRIME;
+			hash ^= hash >> 29;
+		}
+		return hash;
+	}
+}
@@ -0,0 +1,250 @@
+/*
+ *  FrameQueue.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "FrameQueue.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace itg
+{
+	Frame::Frame() :
+		pixels(NULL), time(0.f), keyframe(false), owner(NULL), callback(NULL), userData(NULL), size(0), refs(0), partial(false)
+	{
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) planes[i] = NULL;
+	}
+
+	void Frame::retain()
+	{
+		atomicIncrement(&refs);
+	}
+
+	void Frame::release()
+	{
+		if (atomicDecrement(&refs) == 0) owner->recycle(this);
+	}
+
+	void Frame::addDirtyRect(const FrameRect& rect)
+	{
+		partial = true;
+		dirtyRects.push_back(rect);
+	}
+
+	void Frame::setUnchanged()
+	{
+		partial = true;
+		dirtyRects.clear();
+	}
+
+	void Frame::getDirtyBands(int height, std::vector<unsigned char>& bands) const
+	{
+		int numBands = (height + DIRTY_BAND_HEIGHT - 1) / DIRTY_BAND_HEIGHT;
+		bands.assign(numBands, 0);
+		for (unsigned i = 0; i < dirtyRects.size(); i++)
+		{
+			const FrameRect& rect = dirtyRects[i];
+			if (rect.width <= 0 || rect.height <= 0) continue;
+			int first = std::max(rect.y, 0) / DIRTY_BAND_HEIGHT;
+			int last = std::min(rect.y + rect.height - 1, height - 1) / DIRTY_BAND_HEIGHT;
+			for (int band = first; band <= last; band++) bands[band] = 1;
+		}
+	}
+
+	FrameQueue::FrameQueue(ThreadFactory* threads) : frameSize(0)
+	{
+		queueMutex = threads->createMutex();
+		poolMutex = threads->createMutex();
+	}
+
+	FrameQueue::~FrameQueue()
+	{
+		clear();
+		for (unsigned i = 0; i < shells.size(); i++)
+		{
+			delete shells[i];
+		}
+		delete queueMutex;
+		delete poolMutex;
+	}
+
+	void FrameQueue::allocate(const FrameFormat& format, int numFrames)
+	{
+		clear();
+		this->format = format;
+		frameSize = format.getSize();
+		ScopedLock lock(poolMutex);
+		for (int i = 0; i < numFrames; i++)
+		{
+			pool.push_back(newFrame());
+		}
+	}
+
+	Frame* FrameQueue::newFrame()
+	{
+		Frame* frame = new Frame();
+		frame->owner = this;
+		frame->size = frameSize;
+		frame->pixels = new unsigned char[frameSize];
+		format.fillPlanes(frame->pixels, frame->planes);
+		return frame;
+	}
+
+	void FrameQueue::clear()
+	{
+		std::deque<Frame*> queued;
+		{
+			ScopedLock lock(queueMutex);
+			queued.swap(queue);
+		}
+		// let app frames go back to the app, pooled ones land in the pool and get deleted below
+		for (unsigned i = 0; i < queued.size(); i++)
+		{
+			queued[i]->release();
+		}
+
+		ScopedLock lock(poolMutex);
+		for (unsigned i = 0; i < pool.size(); i++)
+		{
+			delete[] pool[i]->pixels;
+			delete pool[i];
+		}
+		pool.clear();
+	}
+
+	Frame* FrameQueue::acquire()
+	{
+		Frame* frame = NULL;
+		{
+			ScopedLock lock(poolMutex);
+			if (!pool.empty())
+			{
+				frame = pool.back();
+				pool.pop_back();
+			}
+		}
+		if (!frame) frame = newFrame();
+		frame->refs = 1;
+		frame->partial = false;
+		frame->dirtyRects.clear();
+		frame->keyframe = false;
+		frame->chapters.clear();
+		return frame;
+	}
+
+	Frame* FrameQueue::wrap(unsigned char* pixels, FrameReleaseCallback callback, void* userData)
+	{
+		unsigned char* planes[FrameFormat::MAX_PLANES];
+		format.fillPlanes(pixels, planes);
+		return wrap(planes, callback, userData);
+	}
+
+	Frame* FrameQueue::wrap(unsigned char* const planes[], FrameReleaseCallback callback, void* userData)
+	{
+		Frame* frame = NULL;
+		{
+			ScopedLock lock(poolMutex);
+			if (!shells.empty())
+			{
+				frame = shells.back();
+				shells.pop_back();
+			}
+		}
+		if (!frame)
+		{
+			frame = new Frame();
+			frame->owner = this;
+		}
+		int numPlanes = format.getNumPlanes();
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) frame->planes[i] = i < numPlanes ? planes[i] : NULL;
+		frame->pixels = planes[0];
+		frame->callback = callback;
+		frame->userData = userData;
+		frame->refs = 1;
+		frame->partial = false;
+		frame->dirtyRects.clear();
+		frame->keyframe = false;
+		frame->chapters.clear();
+		return frame;
+	}
+
+	void FrameQueue::recycle(Frame* frame)
+	{
+		if (frame->callback)
+		{
+			// app memory, hand it back and keep the shell
+			frame->callback(frame->pixels, frame->userData);
+			frame->callback = NULL;
+			frame->userData = NULL;
+			frame->pixels = NULL;
+			for (int i = 0; i < FrameFormat::MAX_PLANES; i++) frame->planes[i] = NULL;
+			ScopedLock lock(poolMutex);
+			shells.push_back(frame);
+		}
+		else if (frame->size != frameSize)
+		{
+			// borrowed before the pool was reallocated at a different size
+			delete[] frame->pixels;
+			delete frame;
+		}
+		else
+		{
+			ScopedLock lock(poolMutex);
+			pool.push_back(frame);
+		}
+	}
+
+	void FrameQueue::push(Frame* frame)
+	{
+		ScopedLock lock(queueMutex);
+		queue.push_back(frame);
+	}
+
+	Frame* FrameQueue::pop()
+	{
+		ScopedLock lock(queueMutex);
+		if (queue.empty()) return NULL;
+		Frame* frame = queue.front();
+		queue.pop_front();
+		return frame;
+	}
+
+	bool FrameQueue::empty()
+	{
+		ScopedLock lock(queueMutex);
+		return queue.empty();
+	}
+
+	int FrameQueue::size()
+	{
+		ScopedLock lock(queueMutex);
+		return queue.size();
+	}
+}
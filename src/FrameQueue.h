@@ -0,0 +1,148 @@
+/*
+ *  FrameQueue.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "ExporterPlatform.h"
+#include "FrameFormat.h"
+
+namespace itg
+{
+	class FrameQueue;
+
+	// called once the exporter is finished with a buffer the app handed over
+	typedef void (*FrameReleaseCallback)(unsigned char* pixels, void* userData);
+
+	// part of a frame that changed since the previous one, in pixels from the top left
+	struct FrameRect
+	{
+		FrameRect(int x = 0, int y = 0, int width = 0, int height = 0) : x(x), y(y), width(width), height(height) {}
+		int x, y, width, height;
+	};
+
+	// a reference counted buffer on its way from capture to the encoder, either
+	// one of the queue's own buffers or app memory wrapped with a release callback
+	class Frame
+	{
+	public:
+		// first plane, the whole frame for packed formats
+		unsigned char* pixels;
+		// laid out as described by the queue's FrameFormat
+		unsigned char* planes[FrameFormat::MAX_PLANES];
+		// capture clock time, set by the exporter when the frame is added
+		float time;
+		// encode as an intra frame, from MovieExporter::markKeyframe()
+		bool keyframe;
+		// chapters starting on this frame, from MovieExporter::addChapter()
+		std::vector<std::string> chapters;
+
+		// frames are converted in bands of this many rows when only part of them changed,
+		// one macroblock row for the encoder
+		static const int DIRTY_BAND_HEIGHT = 16;
+
+		// only the rects added here changed since the previous frame, the rest of the frame
+		// doesn't need to hold valid pixels.  Frames without any are treated as all new
+		void addDirtyRect(const FrameRect& rect);
+		// nothing changed since the previous frame
+		void setUnchanged();
+		inline bool isPartial() const { return partial; }
+		inline const std::vector<FrameRect>& getDirtyRects() const { return dirtyRects; }
+		// flag the bands of a frame this high touched by the dirty rects, resizes bands
+		// to one entry per DIRTY_BAND_HEIGHT rows
+		void getDirtyBands(int height, std::vector<unsigned char>& bands) const;
+
+		void retain();
+		// the last release returns pooled buffers to the queue or calls the app's callback
+		void release();
+
+	private:
+		friend class FrameQueue;
+		Frame();
+
+		FrameQueue* owner;
+		FrameReleaseCallback callback;
+		void* userData;
+		int size;
+		volatile int refs;
+		bool partial;
+		std::vector<FrameRect> dirtyRects;
+	};
+
+	// frames handed from the capture thread to the encoder thread, used buffers
+	// go back into a pool so we don't allocate while recording
+	class FrameQueue
+	{
+	public:
+		FrameQueue(ThreadFactory* threads);
+		// all borrowed frames must have been released
+		~FrameQueue();
+
+		// (re)allocate numFrames buffers big enough for format, drops anything queued
+		void allocate(const FrameFormat& format, int numFrames);
+		void clear();
+
+		// get an unused buffer with one reference, allocates a new one if the pool is empty
+		Frame* acquire();
+		// wrap memory owned by the app, callback is called once the last reference is released
+		Frame* wrap(unsigned char* pixels, FrameReleaseCallback callback, void* userData);
+		// same for formats with separately allocated planes, one pointer per plane
+		// of the format, callback gets planes[0]
+		Frame* wrap(unsigned char* const planes[], FrameReleaseCallback callback, void* userData);
+
+		// queue a filled frame for encoding, the queue takes over the caller's reference
+		void push(Frame* frame);
+		// oldest queued frame or NULL if there isn't one, the caller releases it
+		Frame* pop();
+
+		bool empty();
+		int size();
+		inline int getFrameSize() const { return frameSize; }
+		inline const FrameFormat& getFormat() const { return format; }
+
+	private:
+		friend class Frame;
+		void recycle(Frame* frame);
+		Frame* newFrame();
+
+		std::deque<Frame*> queue;
+		// pooled buffers
+		std::deque<Frame*> pool;
+		// empty frames for wrapping app memory
+		std::deque<Frame*> shells;
+		Mutex* queueMutex;
+		Mutex* poolMutex;
+		FrameFormat format;
+		int frameSize;
+	};
+}
@@ -0,0 +1,312 @@
+/*
+ *  GifEncoder.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "GifEncoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace itg
+{
+	ColorHistogram::ColorHistogram() : counts(NUM_BINS, 0)
+	{
+	}
+
+	void ColorHistogram::clear()
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+	}
+
+	void ColorHistogram::add(const unsigned char* rgb, int numPixels)
+	{
+		for (int i = 0; i < numPixels; i++, rgb += 3)
+		{
+			counts[getBin(rgb[0], rgb[1], rgb[2])]++;
+		}
+	}
+
+	namespace
+	{
+		// histogram bins while the palette is being cut
+		struct ColorBin
+		{
+			unsigned char rgb[3];
+			uint64_t count;
+		};
+
+		struct ColorBinLess
+		{
+			ColorBinLess(int channel) : channel(channel) {}
+			bool operator()(const ColorBin& a, const ColorBin& b) const { return a.rgb[channel] < b.rgb[channel]; }
+			int channel;
+		};
+
+		// bins [begin, end) of the sorted list
+		struct ColorBox
+		{
+			int begin, end;
+			uint64_t count;
+			int channel;
+			int range;
+		};
+
+		ColorBox makeBox(const std::vector<ColorBin>& bins, int begin, int end)
+		{
+			ColorBox box;
+			box.begin = begin;
+			box.end = end;
+			box.count = 0;
+			int lo[3] = { 255, 255, 255 };
+			int hi[3] = { 0, 0, 0 };
+			for (int i = begin; i < end; i++)
+			{
+				box.count += bins[i].count;
+				for (int c = 0; c < 3; c++)
+				{
+					lo[c] = std::min(lo[c], (int)bins[i].rgb[c]);
+					hi[c] = std::max(hi[c], (int)bins[i].rgb[c]);
+				}
+			}
+			box.channel = 0;
+			for (int c = 1; c < 3; c++)
+			{
+				if (hi[c] - lo[c] > hi[box.channel] - lo[box.channel]) box.channel = c;
+			}
+			box.range = hi[box.channel] - lo[box.channel];
+			return box;
+		}
+
+		// 4x4 Bayer matrix
+		const int BAYER[4][4] = {
+			{ 0, 8, 2, 10 },
+			{ 12, 4, 14, 6 },
+			{ 3, 11, 1, 9 },
+			{ 15, 7, 13, 5 }
+		};
+	}
+
+	GifPalette::GifPalette() : lookup(ColorHistogram::NUM_BINS, 0)
+	{
+		memset(colors, 0, sizeof(colors));
+	}
+
+	void GifPalette::build(const ColorHistogram& histogram)
+	{
+		std::vector<ColorBin> bins;
+		const int mask = (1 << ColorHistogram::BITS) - 1;
+		for (int i = 0; i < ColorHistogram::NUM_BINS; i++)
+		{
+			if (!histogram.getCount(i)) continue;
+			ColorBin bin;
+			// bin centres
+			bin.rgb[0] = (((i >> (2 * ColorHistogram::BITS)) & mask) << 3) | 4;
+			bin.rgb[1] = (((i >> ColorHistogram::BITS) & mask) << 3) | 4;
+			bin.rgb[2] = ((i & mask) << 3) | 4;
+			bin.count = histogram.getCount(i);
+			bins.push_back(bin);
+		}
+
+		// median cut, always splitting the box with the most pixels spread over the widest range
+		std::vector<ColorBox> boxes;
+		if (!bins.empty()) boxes.push_back(makeBox(bins, 0, bins.size()));
+		while ((int)boxes.size() < NUM_COLORS)
+		{
+			int split = -1;
+			double bestScore = 0;
+			for (unsigned i = 0; i < boxes.size(); i++)
+			{
+				double score = (double)boxes[i].count * boxes[i].range;
+				if (boxes[i].end - boxes[i].begin > 1 && score > bestScore)
+				{
+					split = i;
+					bestScore = score;
+				}
+			}
+			if (split < 0) break;
+
+			ColorBox box = boxes[split];
+			std::sort(bins.begin() + box.begin, bins.begin() + box.end, ColorBinLess(box.channel));
+			uint64_t half = box.count / 2;
+			uint64_t sum = 0;
+			int median = box.begin + 1;
+			for (int i = box.begin; i < box.end - 1; i++)
+			{
+				sum += bins[i].count;
+				median = i + 1;
+				if (sum >= half) break;
+			}
+			boxes[split] = makeBox(bins, box.begin, median);
+			boxes.push_back(makeBox(bins, median, box.end));
+		}
+
+		memset(colors, 0, sizeof(colors));
+		for (unsigned i = 0; i < boxes.size(); i++)
+		{
+			uint64_t sum[3] = { 0, 0, 0 };
+			for (int j = boxes[i].begin; j < boxes[i].end; j++)
+			{
+				for (int c = 0; c < 3; c++) sum[c] += bins[j].rgb[c] * bins[j].count;
+			}
+			for (int c = 0; c < 3; c++) colors[3 * i + c] = sum[c] / boxes[i].count;
+		}
+
+		// nearest colour for every bin, so quantizing is a table lookup
+		int numColors = std::max((int)boxes.size(), 1);
+		for (int i = 0; i < ColorHistogram::NUM_BINS; i++)
+		{
+			int r = (((i >> (2 * ColorHistogram::BITS)) & mask) << 3) | 4;
+			int g = (((i >> ColorHistogram::BITS) & mask) << 3) | 4;
+			int b = ((i & mask) << 3) | 4;
+			int best = 0;
+			int bestDist = 0x7fffffff;
+			for (int j = 0; j < numColors; j++)
+			{
+				int dr = r - colors[3 * j];
+				int dg = g - colors[3 * j + 1];
+				int db = b - colors[3 * j + 2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist)
+				{
+					best = j;
+					bestDist = dist;
+				}
+			}
+			lookup[i] = best;
+		}
+	}
+
+	void GifPalette::quantize(const unsigned char* rgb, int rowBytes, int x, int y, int w, int h, bool dither, unsigned char* indices) const
+	{
+		for (int row = y; row < y + h; row++)
+		{
+			const unsigned char* pixel = rgb + row * rowBytes + 3 * x;
+			for (int col = x; col < x + w; col++, pixel += 3)
+			{
+				if (dither)
+				{
+					// about one palette step either way
+					int offset = 2 * BAYER[row & 3][col & 3] - 15;
+					int r = std::min(std::max(pixel[0] + offset, 0), 255);
+					int g = std::min(std::max(pixel[1] + offset, 0), 255);
+					int b = std::min(std::max(pixel[2] + offset, 0), 255);
+					*indices++ = lookup[ColorHistogram::getBin(r, g, b)];
+				}
+				else *indices++ = lookup[ColorHistogram::getBin(pixel[0], pixel[1], pixel[2])];
+			}
+		}
+	}
+
+	GifLzw::GifLzw() : keys(HASH_SIZE), codes(HASH_SIZE), codeSize(0), bits(0), numBits(0), blockSize(0)
+	{
+	}
+
+	void GifLzw::encode(const unsigned char* indices, int numPixels, std::vector<unsigned char>& out)
+	{
+		const int clearCode = 1 << MIN_CODE_SIZE;
+		const int endCode = clearCode + 1;
+
+		out.push_back(MIN_CODE_SIZE);
+		bits = 0;
+		numBits = 0;
+		blockSize = 0;
+		codeSize = MIN_CODE_SIZE + 1;
+		clearTable();
+		writeCode(clearCode, out);
+
+		int maxCode = endCode;
+		int prefix = numPixels ? indices[0] : 0;
+		for (int i = 1; i < numPixels; i++)
+		{
+			int key = (indices[i] << 12) | prefix;
+			int slot = ((indices[i] << 4) ^ prefix) % HASH_SIZE;
+			while (keys[slot] != -1 && keys[slot] != key)
+			{
+				if (++slot == HASH_SIZE) slot = 0;
+			}
+			if (keys[slot] == key)
+			{
+				prefix = codes[slot];
+				continue;
+			}
+
+			writeCode(prefix, out);
+			keys[slot] = key;
+			codes[slot] = ++maxCode;
+			if (maxCode >= (1 << codeSize)) codeSize++;
+			if (maxCode == MAX_CODE)
+			{
+				// table full, start again
+				writeCode(clearCode, out);
+				clearTable();
+				codeSize = MIN_CODE_SIZE + 1;
+				maxCode = endCode;
+			}
+			prefix = indices[i];
+		}
+		if (numPixels) writeCode(prefix, out);
+		writeCode(endCode, out);
+
+		if (numBits > 0)
+		{
+			block[blockSize++] = bits & 0xff;
+			if (blockSize == 255) flushBlock(out);
+		}
+		flushBlock(out);
+		out.push_back(0);
+	}
+
+	void GifLzw::clearTable()
+	{
+		std::fill(keys.begin(), keys.end(), -1);
+	}
+
+	void GifLzw::writeCode(int code, std::vector<unsigned char>& out)
+	{
+		// least significant bit first
+		bits |= code << numBits;
+		numBits += codeSize;
+		while (numBits >= 8)
+		{
+			block[blockSize++] = bits & 0xff;
+			if (blockSize == 255) flushBlock(out);
+			bits >>= 8;
+			numBits -= 8;
+		}
+	}
+
+	void GifLzw::flushBlock(std::vector<unsigned char>& out)
+	{
+		if (!blockSize) return;
+		out.push_back(blockSize);
+		out.insert(out.end(), block, block + blockSize);
+		blockSize = 0;
+	}
+}
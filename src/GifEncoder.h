@@ -0,0 +1,107 @@
+/*
+ *  GifEncoder.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "LibAv.h"
+
+namespace itg
+{
+	// colours counted at 5 bits per channel, enough to build a palette from
+	// without keeping the frames around
+	class ColorHistogram
+	{
+	public:
+		static const int BITS = 5;
+		static const int NUM_BINS = 1 << (3 * BITS);
+
+		ColorHistogram();
+		void clear();
+		// numPixels of packed RGB
+		void add(const unsigned char* rgb, int numPixels);
+		inline uint64_t getCount(int bin) const { return counts[bin]; }
+
+		static inline int getBin(int r, int g, int b) { return ((r >> 3) << (2 * BITS)) | ((g >> 3) << BITS) | (b >> 3); }
+
+	private:
+		std::vector<uint64_t> counts;
+	};
+
+	// 256 colours picked by median cut, with ordered dithering into them.  Ordered
+	// dithering only depends on a pixel's colour and position, so pixels that didn't
+	// change between frames get the same index and frames can be dithered in any order
+	class GifPalette
+	{
+	public:
+		static const int NUM_COLORS = 256;
+
+		GifPalette();
+		void build(const ColorHistogram& histogram);
+		// indices for the w x h rect at x, y of an image of packed RGB rows
+		void quantize(const unsigned char* rgb, int rowBytes, int x, int y, int w, int h, bool dither, unsigned char* indices) const;
+		// NUM_COLORS RGB triples
+		inline const unsigned char* getColors() const { return colors; }
+
+	private:
+		unsigned char colors[NUM_COLORS * 3];
+		// nearest colour to each histogram bin
+		std::vector<unsigned char> lookup;
+	};
+
+	// GIF's variable code length LZW for 8 bit indices, one per worker
+	class GifLzw
+	{
+	public:
+		static const int MIN_CODE_SIZE = 8;
+
+		GifLzw();
+		// appends the minimum code size, the data sub-blocks and the block terminator to out
+		void encode(const unsigned char* indices, int numPixels, std::vector<unsigned char>& out);
+
+	private:
+		static const int HASH_SIZE = 5003;
+		static const int MAX_CODE = 4095;
+
+		void clearTable();
+		void writeCode(int code, std::vector<unsigned char>& out);
+		void flushBlock(std::vector<unsigned char>& out);
+
+		// (index << 12 | prefix) -> code, open addressing
+		std::vector<int> keys;
+		std::vector<short> codes;
+		int codeSize;
+		unsigned bits;
+		int numBits;
+		unsigned char block[255];
+		int blockSize;
+	};
+}
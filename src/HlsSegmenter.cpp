@@ -0,0 +1,209 @@
+/*
+ *  HlsSegmenter.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "HlsSegmenter.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace itg
+{
+	const float HlsSegmenter::TARGET_SEGMENT_SECONDS = 2.f;
+
+	HlsSegmenter::HlsSegmenter(Logger* logger) :
+		logger(logger),
+		opened(false),
+		videoStream(NULL),
+		audioStream(NULL),
+		segment(logger),
+		segmentIndex(0),
+		segmentStartPts(0),
+		lastVideoPts(0)
+	{
+	}
+
+	HlsSegmenter::~HlsSegmenter()
+	{
+		close();
+	}
+
+	bool HlsSegmenter::open(const std::string& playlistPath, AVStream* videoStream, AVStream* audioStream)
+	{
+		close();
+		if (videoStream->codec->flags & CODEC_FLAG_GLOBAL_HEADER)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: HLS needs the \"mpegts\" container so the codec headers are in the stream");
+			return false;
+		}
+
+		this->playlistPath = playlistPath;
+		this->videoStream = videoStream;
+		this->audioStream = audioStream;
+		size_t slash = playlistPath.find_last_of("/\\");
+		folder = slash == std::string::npos ? "" : playlistPath.substr(0, slash + 1);
+		name = playlistPath.substr(folder.size());
+		name = name.substr(0, name.find_last_of('.'));
+
+		segmentIndex = 0;
+		playlist.clear();
+		opened = true;
+		return true;
+	}
+
+	void HlsSegmenter::writePacket(AVPacket* pkt)
+	{
+		bool video = pkt->stream_index == videoStream->index;
+		if (video)
+		{
+			// segments have to start on a keyframe so each can be played on its own
+			if (pkt->flags & AV_PKT_FLAG_KEY)
+			{
+				if (!segment.isOpen()) openSegment(pkt->pts);
+				else if (av_q2d(videoStream->time_base) * (pkt->pts - segmentStartPts) >= TARGET_SEGMENT_SECONDS)
+				{
+					closeSegment(pkt->pts);
+					openSegment(pkt->pts);
+				}
+			}
+			lastVideoPts = pkt->pts;
+		}
+		// anything before the first keyframe
+		if (!segment.isOpen()) return;
+
+		AVStream* source = video ? videoStream : audioStream;
+		AVStream* dest = segment.getFormatContext()->streams[video ? 0 : 1];
+		AVPacket out = *pkt;
+		out.stream_index = dest->index;
+		out.pts = av_rescale_q(pkt->pts, source->time_base, dest->time_base);
+		out.dts = av_rescale_q(pkt->dts, source->time_base, dest->time_base);
+		segment.writePacket(&out);
+		// the muxer takes over the data when it has to hold the packet back for interleaving
+		pkt->destruct = out.destruct;
+	}
+
+	void HlsSegmenter::flush()
+	{
+		segment.flush();
+	}
+
+	void HlsSegmenter::finish()
+	{
+		if (!opened) return;
+		// the last frame is shown for about as long as the one before it
+		if (segment.isOpen()) closeSegment(lastVideoPts + 1);
+		writePlaylist(true);
+	}
+
+	void HlsSegmenter::close()
+	{
+		segment.close();
+		opened = false;
+	}
+
+	bool HlsSegmenter::isPlaylistPath(const std::string& filePath)
+	{
+		return filePath.size() > 5 && filePath.compare(filePath.size() - 5, 5, ".m3u8") == 0;
+	}
+
+// PRIVATE
+
+	bool HlsSegmenter::openSegment(int64_t startPts)
+	{
+		segmentStartPts = startPts;
+		if (!segment.setup("ts", videoStream->codec->codec_id)) return false;
+		if (!segment.addStreamCopy(videoStream)) return false;
+		if (audioStream && !segment.addStreamCopy(audioStream)) return false;
+		if (!segment.setParameters()) return false;
+		return segment.open(folder + getSegmentName(segmentIndex));
+	}
+
+	void HlsSegmenter::closeSegment(int64_t endPts)
+	{
+		segment.finish();
+		segment.close();
+
+		Segment finished;
+		finished.index = segmentIndex++;
+		finished.duration = av_q2d(videoStream->time_base) * (endPts - segmentStartPts);
+		playlist.push_back(finished);
+		int expired = -1;
+		if ((int)playlist.size() > PLAYLIST_LENGTH)
+		{
+			expired = playlist.front().index;
+			playlist.pop_front();
+		}
+		writePlaylist(false);
+
+		// only once the playlist no longer lists it, and a little later than that
+		if (expired >= EXPIRED_SEGMENTS_KEPT) remove((folder + getSegmentName(expired - EXPIRED_SEGMENTS_KEPT)).c_str());
+	}
+
+	bool HlsSegmenter::writePlaylist(bool ended)
+	{
+		std::string tmpPath = playlistPath + ".tmp";
+		FILE* file = fopen(tmpPath.c_str(), "w");
+		if (!file)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not write %s", tmpPath.c_str());
+			return false;
+		}
+
+		float targetDuration = TARGET_SEGMENT_SECONDS;
+		for (unsigned i = 0; i < playlist.size(); i++)
+		{
+			if (playlist[i].duration > targetDuration) targetDuration = playlist[i].duration;
+		}
+		fprintf(file, "#EXTM3U\n#EXT-X-VERSION:3\n");
+		fprintf(file, "#EXT-X-TARGETDURATION:%d\n", (int)ceilf(targetDuration));
+		fprintf(file, "#EXT-X-MEDIA-SEQUENCE:%d\n", playlist.empty() ? 0 : playlist.front().index);
+		for (unsigned i = 0; i < playlist.size(); i++)
+		{
+			fprintf(file, "#EXTINF:%.3f,\n%s\n", playlist[i].duration, getSegmentName(playlist[i].index).c_str());
+		}
+		if (ended) fprintf(file, "#EXT-X-ENDLIST\n");
+
+		bool written = !ferror(file);
+		written = fclose(file) == 0 && written;
+		if (!written || !replaceFile(tmpPath, playlistPath))
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not update %s", playlistPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	std::string HlsSegmenter::getSegmentName(int index) const
+	{
+		char number[32];
+		snprintf(number, sizeof(number), "_%05d.ts", index);
+		return name + number;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ *  HlsSegmenter.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <string>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "Muxer.h"
+
+namespace itg
+{
+	// cuts a live stream into MPEG-TS segments at keyframes and keeps an HLS playlist of the
+	// latest ones next to them, for serving a preview from a folder over plain HTTP.  The
+	// playlist is written to a temporary file and renamed over the old one so players never
+	// read a half written playlist
+	class HlsSegmenter : public PacketSink
+	{
+	public:
+		// segments are cut at the first keyframe after this long
+		static const float TARGET_SEGMENT_SECONDS;
+		// segments listed in the live playlist
+		static const int PLAYLIST_LENGTH = 6;
+		// segments kept on disk after dropping off the playlist, for players still fetching them
+		static const int EXPIRED_SEGMENTS_KEPT = 2;
+
+		HlsSegmenter(Logger* logger);
+		~HlsSegmenter();
+
+		// playlistPath is the .m3u8, segments go next to it as <name>_00000.ts.  Packets come
+		// in with the stream indices and time bases of the streams being encoded, whose codec
+		// parameters each segment copies, audioStream can be NULL
+		bool open(const std::string& playlistPath, AVStream* videoStream, AVStream* audioStream);
+		// not thread safe, one thread writes the packets
+		void writePacket(AVPacket* pkt);
+		void flush();
+		// close the last segment and end the playlist
+		void finish();
+		void close();
+
+		inline bool isOpen() const { return opened; }
+
+		static bool isPlaylistPath(const std::string& filePath);
+
+	private:
+		struct Segment
+		{
+			int index;
+			float duration;
+		};
+
+		bool openSegment(int64_t startPts);
+		void closeSegment(int64_t endPts);
+		bool writePlaylist(bool ended);
+		std::string getSegmentName(int index) const;
+
+		Logger* logger;
+		bool opened;
+		std::string playlistPath;
+		// folder with a trailing slash, and the playlist's name without .m3u8
+		std::string folder;
+		std::string name;
+		AVStream* videoStream;
+		AVStream* audioStream;
+
+		Muxer segment;
+		int segmentIndex;
+		// in the video stream's time base
+		int64_t segmentStartPts;
+		int64_t lastVideoPts;
+		std::deque<Segment> playlist;
+	};
+}
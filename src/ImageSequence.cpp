@@ -0,0 +1,352 @@
+/*
+ *  ImageSequence.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "ImageSequence.h"
+
+#include <cstdio>
+
+namespace itg
+{
+	ImageSequenceSettings::ImageSequenceSettings() :
+		outW(0), outH(0),
+		format(IMAGE_PNG),
+		compression(-1),
+		numWorkers(0),
+		finished(NULL),
+		finishedUserData(NULL)
+	{
+	}
+
+	ImageWriter::ImageWriter(ImageSequence* sequence, Logger* logger) :
+		sequence(sequence),
+		logger(logger),
+		codecCtx(NULL),
+		frame(NULL),
+		pixels(NULL),
+		encodedBuf(NULL),
+		encodedBufSize(0),
+		quality(0)
+	{
+	}
+
+	ImageWriter::~ImageWriter()
+	{
+		close();
+	}
+
+	bool ImageWriter::open(const ImageSequenceSettings& settings)
+	{
+		close();
+
+		CodecID codecId = CODEC_ID_PNG;
+		PixelFormat pixFmt = PIX_FMT_RGB24;
+		if (settings.format == IMAGE_JPEG)
+		{
+			codecId = CODEC_ID_MJPEG;
+			pixFmt = PIX_FMT_YUVJ420P;
+		}
+		else if (settings.format == IMAGE_TIFF) codecId = CODEC_ID_TIFF;
+
+		AVCodec* codec = avcodec_find_encoder(codecId);
+		if (!codec)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Image codec not found");
+			return false;
+		}
+
+		codecCtx = avcodec_alloc_context3(codec);
+		codecCtx->width = settings.outW;
+		codecCtx->height = settings.outH;
+		codecCtx->pix_fmt = pixFmt;
+		// the files have no timing but the encoders still want a time base
+		codecCtx->time_base.num = 1;
+		codecCtx->time_base.den = 25;
+		if (settings.format == IMAGE_JPEG)
+		{
+			// quality 1-100 onto qscale 31-2, set on each frame as it's a fixed qscale
+			int jpegQuality = settings.compression < 0 ? 90 : settings.compression;
+			if (jpegQuality < 1) jpegQuality = 1;
+			if (jpegQuality > 100) jpegQuality = 100;
+			quality = FF_QP2LAMBDA * (31 - (jpegQuality - 1) * 29 / 99);
+			codecCtx->flags |= CODEC_FLAG_QSCALE;
+			codecCtx->global_quality = quality;
+		}
+		else codecCtx->compression_level = settings.compression < 0 ? FF_COMPRESSION_DEFAULT : settings.compression;
+
+		if (avcodec_open(codecCtx, codec) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open image codec");
+			av_freep(&codecCtx);
+			return false;
+		}
+
+		converter.setup(settings.inFormat, settings.outW, settings.outH, pixFmt);
+		pixels = (unsigned char*)av_malloc(avpicture_get_size(pixFmt, settings.outW, settings.outH));
+		frame = avcodec_alloc_frame();
+		avpicture_fill((AVPicture*)frame, pixels, pixFmt, settings.outW, settings.outH);
+
+		// room for incompressible images plus headers
+		encodedBufSize = 2 * avpicture_get_size(PIX_FMT_RGB24, settings.outW, settings.outH) + FF_MIN_BUFFER_SIZE;
+		encodedBuf = (unsigned char*)av_malloc(encodedBufSize);
+		return true;
+	}
+
+	void ImageWriter::close()
+	{
+		if (codecCtx)
+		{
+			avcodec_close(codecCtx);
+			av_freep(&codecCtx);
+		}
+		converter.clear();
+		av_freep(&frame);
+		av_freep(&pixels);
+		av_freep(&encodedBuf);
+		encodedBufSize = 0;
+	}
+
+	bool ImageWriter::write(Frame* in, int index)
+	{
+		converter.convert(in->planes, frame);
+		frame->pts = index;
+		frame->quality = quality;
+		int size = avcodec_encode_video(codecCtx, encodedBuf, encodedBufSize, frame);
+		if (size <= 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not encode image %d", index);
+			return false;
+		}
+
+		std::string filePath = sequence->getFilePath(index);
+		FILE* file = fopen(filePath.c_str(), "wb");
+		if (!file)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open %s", filePath.c_str());
+			return false;
+		}
+		bool written = fwrite(encodedBuf, 1, size, file) == (size_t)size;
+		written = fclose(file) == 0 && written;
+		if (!written) logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not write %s", filePath.c_str());
+		return written;
+	}
+
+#ifdef _THREAD_CAPTURE
+	void ImageWriter::run()
+	{
+		while (true)
+		{
+			// recording is cleared after the last frame is queued so read it before popping
+			bool stopping = !sequence->recording;
+			memoryBarrier();
+
+			int index;
+			Frame* frame = sequence->popFrame(index);
+			if (!frame)
+			{
+				if (stopping) break;
+				sequence->threads->sleepMillis(1);
+				continue;
+			}
+
+			if (write(frame, index)) atomicIncrement(&sequence->numFramesWritten);
+			else atomicIncrement(&sequence->numFramesFailed);
+			frame->release();
+		}
+		sequence->workerFinished();
+	}
+#endif
+
+	ImageSequence::ImageSequence(Logger* logger, ThreadFactory* threads) :
+		logger(logger),
+		threads(threads),
+		frameQueue(threads),
+		nextIndex(0),
+		recording(false),
+		numFramesWritten(0),
+		numFramesFailed(0)
+#ifdef _THREAD_CAPTURE
+		, numWorkersRunning(0)
+#endif
+	{
+		popMutex = threads->createMutex();
+	}
+
+	ImageSequence::~ImageSequence()
+	{
+		stop();
+		join();
+		clearWorkers();
+		delete popMutex;
+	}
+
+	bool ImageSequence::start(const ImageSequenceSettings& settings, const std::string& basePath)
+	{
+		if (recording) return false;
+		// the previous take's workers have to be done with their codecs
+		join();
+		clearWorkers();
+
+		this->settings = settings;
+		this->basePath = basePath;
+		nextIndex = 0;
+		numFramesWritten = 0;
+		numFramesFailed = 0;
+
+#ifdef _THREAD_CAPTURE
+		int numWriters = settings.numWorkers > 0 ? settings.numWorkers : getNumCores();
+#else
+		int numWriters = 1;
+#endif
+		// opened here so a codec that won't open fails record() rather than a worker
+		for (int i = 0; i < numWriters; i++)
+		{
+			writers.push_back(new ImageWriter(this, logger));
+			if (!writers.back()->open(settings))
+			{
+				clearWorkers();
+				return false;
+			}
+		}
+
+		recording = true;
+#ifdef _THREAD_CAPTURE
+		numWorkersRunning = numWriters;
+		for (int i = 0; i < numWriters; i++)
+		{
+			workers.push_back(threads->createThread());
+			workers.back()->start(writers[i]);
+		}
+#endif
+		logger->log(EXPORTER_LOG_NOTICE, "ofxMovieExporter: Writing %s with %d workers", getFilePath(-1).c_str(), numWriters);
+		return true;
+	}
+
+	void ImageSequence::stop()
+	{
+		if (!recording) return;
+		recording = false;
+#ifndef _THREAD_CAPTURE
+		finish();
+#endif
+	}
+
+	bool ImageSequence::isIdle()
+	{
+#ifdef _THREAD_CAPTURE
+		return !recording && numWorkersRunning == 0;
+#else
+		return !recording;
+#endif
+	}
+
+	void ImageSequence::join()
+	{
+#ifdef _THREAD_CAPTURE
+		for (unsigned i = 0; i < workers.size(); i++)
+		{
+			workers[i]->join();
+		}
+#endif
+	}
+
+	void ImageSequence::addFrame(Frame* frame)
+	{
+		if (!recording)
+		{
+			frame->release();
+			return;
+		}
+#ifdef _THREAD_CAPTURE
+		frameQueue.push(frame);
+#else
+		if (writers[0]->write(frame, nextIndex++)) numFramesWritten++;
+		else numFramesFailed++;
+		frame->release();
+#endif
+	}
+
+	std::string ImageSequence::getFilePath(int index) const
+	{
+		char number[32];
+		if (index < 0) snprintf(number, sizeof(number), "_%%0%dd.", NUM_DIGITS);
+		else snprintf(number, sizeof(number), "_%0*d.", NUM_DIGITS, index);
+		return basePath + number + getExtension(settings.format);
+	}
+
+	const char* ImageSequence::getExtension(ImageFormat format)
+	{
+		switch (format)
+		{
+			case IMAGE_JPEG: return "jpg";
+			case IMAGE_TIFF: return "tif";
+			default: return "png";
+		}
+	}
+
+// PRIVATE
+
+	Frame* ImageSequence::popFrame(int& index)
+	{
+		ScopedLock lock(popMutex);
+		Frame* frame = frameQueue.pop();
+		if (frame) index = nextIndex++;
+		return frame;
+	}
+
+#ifdef _THREAD_CAPTURE
+	void ImageSequence::workerFinished()
+	{
+		if (atomicDecrement(&numWorkersRunning) == 0) finish();
+	}
+#endif
+
+	void ImageSequence::finish()
+	{
+		logger->log(EXPORTER_LOG_NOTICE, "ofxMovieExporter: Wrote %d images to %s", (int)numFramesWritten, getFilePath(-1).c_str());
+		if (settings.finished) settings.finished(getFilePath(-1), numFramesFailed == 0, settings.finishedUserData);
+	}
+
+	void ImageSequence::clearWorkers()
+	{
+#ifdef _THREAD_CAPTURE
+		for (unsigned i = 0; i < workers.size(); i++)
+		{
+			delete workers[i];
+		}
+		workers.clear();
+#endif
+		for (unsigned i = 0; i < writers.size(); i++)
+		{
+			delete writers[i];
+		}
+		writers.clear();
+	}
+}
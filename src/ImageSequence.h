@@ -0,0 +1,167 @@
+/*
+ *  ImageSequence.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+#include "FrameConverter.h"
+#include "Recording.h"
+
+namespace itg
+{
+	class ImageSequence;
+
+	enum ImageFormat
+	{
+		IMAGE_PNG,
+		IMAGE_JPEG,
+		IMAGE_TIFF
+	};
+
+	struct ImageSequenceSettings
+	{
+		ImageSequenceSettings();
+
+		FrameFormat inFormat;
+		int outW, outH;
+		ImageFormat format;
+		// zlib level 0-9 for PNG and TIFF, quality 1-100 for JPEG, -1 for the default
+		int compression;
+		// 0 for one per core
+		int numWorkers;
+
+		RecordingFinishedCallback finished;
+		void* finishedUserData;
+	};
+
+	// converts and compresses frames into one image file, each worker of an image sequence has one
+	class ImageWriter
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		ImageWriter(ImageSequence* sequence, Logger* logger);
+		~ImageWriter();
+
+		// not thread safe, libav only allows one thread to open codecs at a time
+		bool open(const ImageSequenceSettings& settings);
+		void close();
+		// false if the file couldn't be encoded or written
+		bool write(Frame* frame, int index);
+
+	private:
+#ifdef _THREAD_CAPTURE
+		void run();
+#endif
+
+		ImageSequence* sequence;
+		Logger* logger;
+		FrameConverter converter;
+		AVCodecContext* codecCtx;
+		AVFrame* frame;
+		unsigned char* pixels;
+		unsigned char* encodedBuf;
+		int encodedBufSize;
+		int quality;
+	};
+
+	// writes every frame of a take to its own numbered file, <basePath>_00000.png and so on.
+	// Frames are handed to a pool of workers that convert, compress and write them in
+	// parallel, so the compression scales with the number of cores rather than being
+	// limited to what one encoder thread can do
+	class ImageSequence
+	{
+	public:
+		static const int NUM_DIGITS = 5;
+
+		ImageSequence(Logger* logger, ThreadFactory* threads);
+		// waits for the sequence to be finished
+		~ImageSequence();
+
+		bool start(const ImageSequenceSettings& settings, const std::string& basePath);
+		// returns straight away, the workers write out the frames already added in the background
+		void stop();
+		// not recording or writing
+		bool isIdle();
+		// block until idle
+		void join();
+
+		inline bool isRecording() const { return recording; }
+
+		// takes over the caller's reference
+		void addFrame(Frame* frame);
+
+		// the path of file index, or with a printf style %05d in place of the number if index < 0
+		std::string getFilePath(int index) const;
+		static const char* getExtension(ImageFormat format);
+
+		inline int getNumFramesWritten() const { return numFramesWritten; }
+		inline int getNumFramesFailed() const { return numFramesFailed; }
+
+	private:
+		friend class ImageWriter;
+
+		// for the workers, the next frame and its number, NULL if there isn't one
+		Frame* popFrame(int& index);
+#ifdef _THREAD_CAPTURE
+		// called by each worker as it exits, the last one finishes the sequence
+		void workerFinished();
+#endif
+		void finish();
+		void clearWorkers();
+
+		Logger* logger;
+		ThreadFactory* threads;
+
+		// only used as a queue, the frames belong to the exporter's pool
+		FrameQueue frameQueue;
+		// numbers frames in the order they come off the queue
+		Mutex* popMutex;
+		int nextIndex;
+
+		ImageSequenceSettings settings;
+		std::string basePath;
+		volatile bool recording;
+		volatile int numFramesWritten;
+		volatile int numFramesFailed;
+
+		std::vector<ImageWriter*> writers;
+#ifdef _THREAD_CAPTURE
+		std::vector<Thread*> workers;
+		volatile int numWorkersRunning;
+#endif
+	};
+}
@@ -0,0 +1,735 @@
+/*
+ *  MovieExporter.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "MovieExporter.h"
+
+namespace itg
+{
+	// libav only lets one thread at a time open or close a codec unless it's given locks,
+	// and recordings, standbys, chunk workers, image writers and the movie reader all do
+	static ThreadFactory* lockThreads = NULL;
+
+	static int lockManager(void** mutex, enum AVLockOp op)
+	{
+		switch (op)
+		{
+		case AV_LOCK_CREATE:
+			*mutex = lockThreads->createMutex();
+			return *mutex ? 0 : 1;
+		case AV_LOCK_OBTAIN:
+			((Mutex*)*mutex)->lock();
+			return 0;
+		case AV_LOCK_RELEASE:
+			((Mutex*)*mutex)->unlock();
+			return 0;
+		case AV_LOCK_DESTROY:
+			delete (Mutex*)*mutex;
+			*mutex = NULL;
+			return 0;
+		}
+		return 1;
+	}
+
+	MovieExporter::MovieExporter(Clock* clock, Logger* logger, ThreadFactory* threads) :
+		clock(clock ? clock : getDefaultClock()),
+		logger(logger ? logger : getDefaultLogger()),
+		threads(threads ? threads : getDefaultThreadFactory()),
+		framePool(this->threads),
+		downscaledPool(this->threads),
+		current(NULL),
+		last(NULL),
+		standby(NULL),
+		warmStandby(false),
+		offline(false),
+		imageSequence(false),
+		sequenceRecording(false),
+		sequence(this->logger, this->threads),
+		animatedGif(false),
+		gifRecording(false),
+		gif(this->logger, this->threads),
+		accumulator(this->logger, this->threads),
+		timeLapseStride(1),
+		timeLapseAccumulate(false),
+		motionBlurSubFrames(1),
+		supersample(1),
+		accumulating(false),
+		accumulateStride(1),
+		timeLapseTicks(0),
+		numSubFrames(0),
+		numOutputFrames(0),
+		outputStartTime(0.f),
+		pendingKeyframe(false),
+		lastFrameTime(0.f)
+	{
+		settings.audioFifoSeconds = AUDIO_FIFO_SECONDS;
+		settings.audioBitRate = AUDIO_BIT_RATE;
+	}
+
+	MovieExporter::~MovieExporter()
+	{
+		stopCurrent();
+		stopStandby();
+		// each one lets its encoder thread drain the queue and write the trailer
+		for (unsigned i = 0; i < recordings.size(); i++)
+		{
+			delete recordings[i];
+		}
+		sequence.join();
+		gif.join();
+		framePool.clear();
+		downscaledPool.clear();
+	}
+
+	void MovieExporter::setup(
+		int inW,
+		int inH,
+		int outW,
+		int outH,
+		int bitRate,
+		int frameRate,
+		CodecID codecId,
+		const std::string& container)
+	{
+		setup(FrameFormat(inW, inH), outW, outH, bitRate, frameRate, codecId, container);
+	}
+
+	void MovieExporter::setup(
+		const FrameFormat& inFormat,
+		int outW,
+		int outH,
+		int bitRate,
+		int frameRate,
+		CodecID codecId,
+		const std::string& container)
+	{
+		// can't reallocate under a recording that is still going
+		stopCurrent();
+		stopStandby();
+		waitForRecordings();
+
+		if (outW % 2 == 1 || outH % 2 == 1) logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Resolution must be a multiple of 2");
+
+		captureFormat = inFormat;
+		settings.outW = outW;
+		settings.outH = outH;
+		settings.frameRate = frameRate;
+		settings.bitRate = bitRate;
+		settings.codecId = codecId;
+		settings.container = container;
+
+		updateFrameInterval();
+
+		// do one time encoder set up
+		av_register_all();
+		if (!lockThreads)
+		{
+			lockThreads = threads;
+			if (av_lockmgr_register(&lockManager) < 0) logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not register the codec lock manager");
+		}
+
+#ifdef _THREAD_CAPTURE
+		framePool.allocate(inFormat, INIT_QUEUE_SIZE);
+#else
+		framePool.allocate(inFormat, 1);
+#endif
+		updateRecordingFormat();
+		startStandby();
+	}
+
+	bool MovieExporter::record(const std::string& filePath)
+	{
+		if (isRecording()) return false;
+
+		timeLapseTicks = 0;
+		pendingKeyframe = false;
+		pendingChapters.clear();
+		numSubFrames = 0;
+		numOutputFrames = 0;
+		outputStartTime = clock->getElapsedTimef();
+		if (isMotionBlur())
+		{
+			if (!FrameAccumulator::canAccumulate(captureFormat))
+			{
+				logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't average frames of this pixel format for motion blur");
+				return false;
+			}
+			if (timeLapseStride > 1) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Time-lapse is ignored while rendering with motion blur");
+			accumulating = true;
+			accumulateStride = motionBlurSubFrames;
+		}
+		else
+		{
+			if (timeLapseStride > 1 && settings.audioEnabled) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Time-lapse audio is recorded in real time, it won't line up with the video");
+			accumulating = timeLapseStride > 1 && timeLapseAccumulate;
+			accumulateStride = timeLapseStride;
+			if (accumulating && !FrameAccumulator::canAccumulate(captureFormat))
+			{
+				logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Can't average frames of this pixel format, keeping every %dth frame instead", timeLapseStride);
+				accumulating = false;
+			}
+		}
+
+		if (imageSequence)
+		{
+			if (settings.audioEnabled) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Image sequences don't record audio");
+			sequenceSettings.inFormat = settings.inFormat;
+			sequenceSettings.outW = settings.outW;
+			sequenceSettings.outH = settings.outH;
+			sequenceSettings.finished = settings.finished;
+			sequenceSettings.finishedUserData = settings.finishedUserData;
+			if (!sequence.start(sequenceSettings, filePath)) return false;
+			lastFrameTime = 0;
+			sequenceRecording = true;
+			return true;
+		}
+
+		if (animatedGif)
+		{
+			if (settings.audioEnabled) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: GIFs don't record audio");
+			gifSettings.inFormat = settings.inFormat;
+			gifSettings.outW = settings.outW;
+			gifSettings.outH = settings.outH;
+			gifSettings.frameInterval = settings.frameInterval;
+			gifSettings.finished = settings.finished;
+			gifSettings.finishedUserData = settings.finishedUserData;
+			if (!gif.start(gifSettings, filePath)) return false;
+			lastFrameTime = 0;
+			gifRecording = true;
+			return true;
+		}
+
+		Recording* recording = NULL;
+#ifdef _THREAD_CAPTURE
+		// only waits if the standby encoder is still being opened
+		if (standby && standby->waitUntilPrepared()) recording = standby;
+		standby = NULL;
+#endif
+		if (!recording)
+		{
+			recording = getIdleRecording();
+			if (!recording->prepare(settings)) return false;
+		}
+		if (!recording->start(filePath)) return false;
+
+		lastFrameTime = 0;
+		last = recording;
+		current = recording;
+		return true;
+	}
+
+	void MovieExporter::stop()
+	{
+		if (!isRecording()) return;
+		stopCurrent();
+		startStandby();
+	}
+
+	void MovieExporter::waitForRecordings()
+	{
+		for (unsigned i = 0; i < recordings.size(); i++)
+		{
+			if (recordings[i] != standby) recordings[i]->join();
+		}
+		sequence.join();
+		gif.join();
+	}
+
+	void MovieExporter::setImageSequence(ImageFormat format, int compression, int numWorkers)
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't switch to an image sequence while recording");
+			return;
+		}
+		// nothing to open ahead of time
+		stopStandby();
+		animatedGif = false;
+		imageSequence = true;
+		sequenceSettings.format = format;
+		sequenceSettings.compression = compression;
+		sequenceSettings.numWorkers = numWorkers;
+		updateFrameInterval();
+	}
+
+	void MovieExporter::setAnimatedGif(bool dither, int numWorkers)
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't switch to a GIF while recording");
+			return;
+		}
+		stopStandby();
+		imageSequence = false;
+		animatedGif = true;
+		gifSettings.dither = dither;
+		gifSettings.numWorkers = numWorkers;
+		updateFrameInterval();
+	}
+
+	void MovieExporter::disableAnimatedGif()
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't switch to movies while recording");
+			return;
+		}
+		animatedGif = false;
+		updateFrameInterval();
+		startStandby();
+	}
+
+	void MovieExporter::disableImageSequence()
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't switch to movies while recording");
+			return;
+		}
+		imageSequence = false;
+		updateFrameInterval();
+		startStandby();
+	}
+
+	void MovieExporter::addRendition(int outW, int outH, int bitRate, CodecID codecId, const std::string& container, const std::string& fileSuffix)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't add a rendition while recording");
+			return;
+		}
+		if (outW % 2 == 1 || outH % 2 == 1) logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Resolution must be a multiple of 2");
+		stopStandby();
+		settings.renditions.push_back(OutputSettings(outW, outH, bitRate, codecId, container, fileSuffix));
+		startStandby();
+	}
+
+	void MovieExporter::clearRenditions()
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't clear renditions while recording");
+			return;
+		}
+		stopStandby();
+		settings.renditions.clear();
+		startStandby();
+	}
+
+	void MovieExporter::setFinishedCallback(RecordingFinishedCallback finished, void* userData)
+	{
+		stopStandby();
+		settings.finished = finished;
+		settings.finishedUserData = userData;
+		startStandby();
+	}
+
+	void MovieExporter::setWarmStandby(bool warmStandby)
+	{
+#ifdef _THREAD_CAPTURE
+		stopStandby();
+		this->warmStandby = warmStandby;
+		startStandby();
+#else
+		if (warmStandby) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Warm standby needs _THREAD_CAPTURE");
+#endif
+	}
+
+	void MovieExporter::setupAudio(int sampleRate, int numChannels, CodecID audioCodecId, int audioBitRate)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't set up audio while recording");
+			return;
+		}
+		// a standby encoder was opened without this audio stream
+		stopStandby();
+		settings.audioEnabled = true;
+		settings.sampleRate = sampleRate;
+		settings.numChannels = numChannels;
+		settings.audioCodecId = audioCodecId;
+		settings.audioBitRate = audioBitRate;
+		updateFrameInterval();
+		startStandby();
+	}
+
+	void MovieExporter::disableAudio()
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't disable audio while recording");
+			return;
+		}
+		stopStandby();
+		settings.audioEnabled = false;
+		updateFrameInterval();
+		startStandby();
+	}
+
+	void MovieExporter::addAudioSamples(const float* samples, int numFrames)
+	{
+		Recording* recording = current;
+		if (recording) recording->addAudioSamples(samples, numFrames);
+	}
+
+	void MovieExporter::setSkipDuplicateFrames(bool skipDuplicateFrames)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change duplicate frame skipping while recording");
+			return;
+		}
+		stopStandby();
+		settings.skipDuplicateFrames = skipDuplicateFrames;
+		startStandby();
+	}
+
+	void MovieExporter::setAdaptiveQuality(bool adaptiveQuality)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change adaptive quality while recording");
+			return;
+		}
+		stopStandby();
+		settings.adaptiveQuality = adaptiveQuality;
+		startStandby();
+	}
+
+	void MovieExporter::setLowLatency(bool lowLatency)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change latency settings while recording");
+			return;
+		}
+		stopStandby();
+		settings.lowLatency = lowLatency;
+		startStandby();
+	}
+
+	void MovieExporter::setOffline(bool offline)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change offline settings while recording");
+			return;
+		}
+		stopStandby();
+		this->offline = offline;
+		settings.offline = offline || isMotionBlur();
+		startStandby();
+	}
+
+	void MovieExporter::setSceneDetection(bool sceneDetection)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change scene detection while recording");
+			return;
+		}
+		stopStandby();
+		settings.sceneDetection = sceneDetection;
+		startStandby();
+	}
+
+	void MovieExporter::markKeyframe()
+	{
+		if (canMark()) pendingKeyframe = true;
+	}
+
+	void MovieExporter::addChapter(const std::string& name)
+	{
+		if (!canMark()) return;
+		pendingKeyframe = true;
+		pendingChapters.push_back(name);
+	}
+
+	void MovieExporter::setTwoPass(bool twoPass, int64_t targetFileSize)
+	{
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change two pass encoding while recording");
+			return;
+		}
+		stopStandby();
+		settings.twoPass = twoPass;
+		settings.targetFileSize = targetFileSize;
+		startStandby();
+	}
+
+	void MovieExporter::setChunkedEncoding(bool chunked, int numWorkers, int chunkFrames)
+	{
+#ifdef _THREAD_CAPTURE
+		if (current)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change chunked encoding while recording");
+			return;
+		}
+		stopStandby();
+		settings.chunkedEncoding = chunked;
+		settings.chunkWorkers = numWorkers;
+		settings.chunkFrames = chunkFrames;
+		startStandby();
+#else
+		if (chunked) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Chunked encoding needs _THREAD_CAPTURE");
+#endif
+	}
+
+	void MovieExporter::setTimeLapse(int stride, bool accumulate)
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change time-lapse settings while recording");
+			return;
+		}
+		timeLapseStride = stride > 1 ? stride : 1;
+		timeLapseAccumulate = accumulate;
+	}
+
+	void MovieExporter::setMotionBlur(int subFrames, int supersample)
+	{
+		if (isRecording())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Can't change motion blur settings while recording");
+			return;
+		}
+		stopStandby();
+		// more would only be summed every so often
+		if (subFrames > FrameAccumulator::MAX_SUMMED_FRAMES) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: At most %d sub-frames per frame are averaged, evenly spaced", FrameAccumulator::MAX_SUMMED_FRAMES);
+		motionBlurSubFrames = subFrames > 1 ? subFrames : 1;
+		this->supersample = supersample > 1 ? supersample : 1;
+		settings.offline = offline || isMotionBlur();
+		// the recordings' size changes with the supersampling, finishing ones may still
+		// hold frames of the old one
+		if (framePool.getFrameSize())
+		{
+			waitForRecordings();
+			updateRecordingFormat();
+		}
+		startStandby();
+	}
+
+	float MovieExporter::getSubFrameTime() const
+	{
+		// by the movie frame, frameInterval can be shorter to pace capture
+		return numSubFrames / (float)(settings.frameRate * motionBlurSubFrames);
+	}
+
+	int MovieExporter::getNumFramesEncoded() const
+	{
+		if (imageSequence) return sequence.getNumFramesWritten();
+		if (animatedGif) return gif.getNumFramesWritten();
+		return last ? last->getNumFramesEncoded() : 0;
+	}
+
+	int MovieExporter::getNumFramesSkipped() const
+	{
+		return last ? last->getNumFramesSkipped() : 0;
+	}
+
+	int MovieExporter::getNumFramesDropped() const
+	{
+		return last ? last->getNumFramesDropped() : 0;
+	}
+
+	int MovieExporter::getNumAudioSamplesDropped() const
+	{
+		return last ? last->getNumAudioSamplesDropped() : 0;
+	}
+
+	QualityGovernor::Level MovieExporter::getQualityLevel() const
+	{
+		return last ? last->getQualityLevel() : QualityGovernor::LEVEL_FULL;
+	}
+
+	float MovieExporter::getStreamLatency() const
+	{
+		return last ? last->getStreamLatency() : 0.f;
+	}
+
+	int MovieExporter::getNumPacketsDropped() const
+	{
+		return last ? last->getNumPacketsDropped() : 0;
+	}
+
+	bool MovieExporter::isFrameDue()
+	{
+		if (!isRecording()) return false;
+		// offline, the app renders as fast as it can
+		if (settings.offline) return true;
+		if (timeLapseStride > 1) return accumulating || timeLapseTicks++ % timeLapseStride == 0;
+		return clock->getElapsedTimef() - lastFrameTime >= settings.frameInterval;
+	}
+
+	Frame* MovieExporter::getFrame()
+	{
+		return framePool.acquire();
+	}
+
+	void MovieExporter::addFrame(Frame* frame)
+	{
+		if (!isRecording())
+		{
+			frame->release();
+			return;
+		}
+		frame->time = clock->getElapsedTimef();
+		if (accumulating)
+		{
+			if (!accumulator.isRunning()) accumulator.start(captureFormat, supersample > 1 ? &downscaledPool : &framePool, accumulateStride, supersample);
+			accumulator.addFrame(frame);
+			numSubFrames++;
+			while (Frame* averaged = accumulator.popAveraged()) deliverFrame(averaged);
+		}
+		else deliverFrame(frame);
+		lastFrameTime = clock->getElapsedTimef();
+	}
+
+	void MovieExporter::addFrame(unsigned char* pixels, FrameReleaseCallback release, void* userData)
+	{
+		addFrame(framePool.wrap(pixels, release, userData));
+	}
+
+	void MovieExporter::addFrame(unsigned char* const planes[], FrameReleaseCallback release, void* userData)
+	{
+		addFrame(framePool.wrap(planes, release, userData));
+	}
+
+// PRIVATE
+
+	void MovieExporter::stopCurrent()
+	{
+		if (accumulator.isRunning())
+		{
+			// the strides that were complete still go out
+			accumulator.stop();
+			while (Frame* averaged = accumulator.popAveraged()) deliverFrame(averaged);
+		}
+		if (sequenceRecording)
+		{
+			sequenceRecording = false;
+			sequence.stop();
+		}
+		if (gifRecording)
+		{
+			gifRecording = false;
+			gif.stop();
+		}
+		if (!current) return;
+		Recording* recording = current;
+		current = NULL;
+		recording->stop();
+	}
+
+	void MovieExporter::deliverFrame(Frame* frame)
+	{
+		// time-lapse and motion blur frames are timed as played back, not as captured
+		if (timeLapseStride > 1 || isMotionBlur()) frame->time = outputStartTime + numOutputFrames++ / (float)settings.frameRate;
+		if (sequenceRecording) sequence.addFrame(frame);
+		else if (gifRecording) gif.addFrame(frame);
+		else
+		{
+			if (pendingKeyframe)
+			{
+				frame->keyframe = true;
+				frame->chapters.swap(pendingChapters);
+				pendingChapters.clear();
+				pendingKeyframe = false;
+			}
+			current->addFrame(frame);
+		}
+	}
+
+	bool MovieExporter::canMark()
+	{
+		if (current) return true;
+		logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Keyframes and chapters can only be marked while recording a movie");
+		return false;
+	}
+
+	Recording* MovieExporter::getIdleRecording()
+	{
+		for (unsigned i = 0; i < recordings.size(); i++)
+		{
+			if (recordings[i] != standby && recordings[i]->isIdle())
+			{
+				recordings[i]->join();
+				return recordings[i];
+			}
+		}
+		recordings.push_back(new Recording(clock, logger, threads));
+		return recordings.back();
+	}
+
+	void MovieExporter::startStandby()
+	{
+#ifdef _THREAD_CAPTURE
+		if (!warmStandby || imageSequence || animatedGif || standby || !framePool.getFrameSize()) return;
+		standby = getIdleRecording();
+		standby->prepareInBackground(settings);
+#endif
+	}
+
+	void MovieExporter::stopStandby()
+	{
+#ifdef _THREAD_CAPTURE
+		if (!standby) return;
+		standby->cancel();
+		standby = NULL;
+#endif
+	}
+
+	void MovieExporter::updateRecordingFormat()
+	{
+		if (supersample > 1 && !FrameAccumulator::canDownscale(captureFormat, supersample))
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Supersampling needs a frame size that divides by %d and a factor of at most %d", 2 * supersample, FrameAccumulator::MAX_DOWNSCALE);
+			supersample = 1;
+		}
+		settings.inFormat = FrameAccumulator::getDownscaledFormat(captureFormat, supersample);
+		if (supersample > 1) downscaledPool.allocate(settings.inFormat, INIT_QUEUE_SIZE);
+		else downscaledPool.clear();
+	}
+
+	void MovieExporter::updateFrameInterval()
+	{
+		settings.frameInterval = 1.f / (float)settings.frameRate;
+
+		// with audio, frames are timestamped from the clock so we can capture at the real rate,
+		// and image sequences and GIFs just want one image per frame
+		if (settings.audioEnabled || imageSequence || animatedGif) return;
+
+		// HACK HACK HACK
+		// Time not syncing
+		// probably related to codec ticks_per_frame
+		settings.frameInterval /= 3.f;
+	}
+}
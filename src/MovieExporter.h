@@ -0,0 +1,318 @@
+/*
+ *  MovieExporter.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Recording.h"
+#include "ImageSequence.h"
+#include "AnimatedGif.h"
+#include "FrameAccumulator.h"
+
+namespace itg
+{
+	// openFrameworks free encoder core, frames go in as packed RGB and come out as a movie file
+	// ofxMovieExporter is a thin wrapper around this that grabs frames from the screen
+	class MovieExporter
+	{
+	public:
+		static const int INIT_QUEUE_SIZE = 50;
+		static const int AUDIO_BIT_RATE = 128000;
+		// how much audio can be waiting for the encoder thread before samples get dropped
+		static const int AUDIO_FIFO_SECONDS = 2;
+
+		// anything left NULL falls back to the OS implementations in ExporterPlatform.h
+		MovieExporter(Clock* clock = NULL, Logger* logger = NULL, ThreadFactory* threads = NULL);
+		// waits for every recording to be finished
+		~MovieExporter();
+
+		// frames go in as described by inFormat, each one is converted exactly once on the encoder thread
+		void setup(const FrameFormat& inFormat, int outW, int outH, int bitRate, int frameRate, CodecID codecId, const std::string& container);
+		// tightly packed top down RGB
+		void setup(int inW, int inH, int outW, int outH, int bitRate, int frameRate, CodecID codecId, const std::string& container);
+		// filePath is used as is, the container is not appended.  For image sequences it's
+		// the start of each file's name, _00000.png and so on are appended, GIFs are
+		// written to filePath as is too.  A URL streams instead of writing a file, use
+		// an "mpegts" container for udp://host:port or "flv" for rtmp://host/app/name.  A path
+		// ending in .m3u8 writes a live HLS playlist and MPEG-TS segments into that folder,
+		// also with "mpegts"
+		bool record(const std::string& filePath);
+		// returns straight away, the frames already added are encoded and the file finished
+		// in the background while the next recording can already be going
+		void stop();
+		bool isRecording() const;
+		// block until every stopped recording has been finished
+		void waitForRecordings();
+
+		// record() writes every frame to its own numbered image rather than a movie,
+		// compressed by numWorkers threads (0 for one per core) in parallel.  compression
+		// is the zlib level 0-9 for PNG and TIFF or the quality 1-100 for JPEG, -1 for the
+		// default.  Frames are saved at the output size, audio and renditions are ignored
+		void setImageSequence(ImageFormat format, int compression = -1, int numWorkers = 0);
+		// back to writing movies
+		void disableImageSequence();
+		inline bool isImageSequence() const { return imageSequence; }
+		inline const char* getImageExtension() const { return ImageSequence::getExtension(sequenceSettings.format); }
+
+		// record() writes a looping animated GIF instead.  Frames are journalled to disk
+		// uncompressed while recording, then after stop() a 256 colour palette is built for
+		// the whole take and numWorkers threads (0 for one per core) dither and compress
+		// the part of each frame that changed.  GIF delays are in hundredths of a second
+		// and most browsers slow anything under 2 down, so keep the frame rate at 50 or less
+		void setAnimatedGif(bool dither = true, int numWorkers = 0);
+		void disableAnimatedGif();
+		inline bool isAnimatedGif() const { return animatedGif; }
+
+		// write another, usually smaller, copy of every recording at the same time, from the
+		// same captured frames.  Renditions are scaled down from the master's YUV (or from the
+		// previous rendition if it's big enough, so add them largest first) and saved next to
+		// it as <name><fileSuffix>.<container>
+		void addRendition(int outW, int outH, int bitRate, CodecID codecId, const std::string& container, const std::string& fileSuffix);
+		void clearRenditions();
+		inline int getNumRenditions() const { return settings.renditions.size(); }
+
+		// called from the encoder thread once each of a recording's files is closed
+		void setFinishedCallback(RecordingFinishedCallback finished, void* userData = NULL);
+
+		// open the codec and muxer on a background thread after setup() and after each
+		// stop(), so record() only has to flag the start and the first frame goes out in
+		// the same tick.  The file itself is opened in the background too, frames queue
+		// up until it is.  Needs _THREAD_CAPTURE
+		void setWarmStandby(bool warmStandby);
+		inline bool isWarmStandby() const { return warmStandby; }
+
+		// record an audio track too, call before record(), samples come in through addAudioSamples()
+		// and both tracks are timestamped from the exporter's clock
+		// tested so far with CODEC_ID_AAC in mp4/mov and CODEC_ID_PCM_S16LE in mov
+		void setupAudio(int sampleRate, int numChannels, CodecID audioCodecId = CODEC_ID_AAC, int audioBitRate = AUDIO_BIT_RATE);
+		void disableAudio();
+		inline bool hasAudio() const { return settings.audioEnabled; }
+		inline int getNumAudioChannels() const { return settings.numChannels; }
+
+		// interleaved float samples, numChannels per frame, safe to call from a sound card callback:
+		// it never locks or allocates, samples that don't fit in the fifo are dropped and counted
+		void addAudioSamples(const float* samples, int numFrames);
+
+		// frames can carry the rects that changed (Frame::addDirtyRect()), without scaling only
+		// the macroblock rows they cover are converted and the rest of the last frame is kept.
+		// The first frame of each recording has to be complete
+		inline bool canConvertPartialFrames() const { return !imageSequence && !animatedGif && !settings.chunkedEncoding && timeLapseStride <= 1 && !isMotionBlur() && settings.inFormat.width == settings.outW && settings.inFormat.height == settings.outH; }
+
+		// frames identical to the one before are neither converted nor encoded, the
+		// previous frame is just shown for longer (variable frame rate in mp4/mov,
+		// repeated frames in containers that don't support it)
+		// costs a hash of every frame on the encoder thread, about 1ms for 1080p RGB
+		void setSkipDuplicateFrames(bool skipDuplicateFrames);
+		inline bool getSkipDuplicateFrames() const { return settings.skipDuplicateFrames; }
+
+		// when the encoder thread falls behind, step down to a cheaper scaler, then faster
+		// motion search, then encode only every second or third frame rather than let the
+		// queue grow, and step back up once it catches up.  Off by default
+		void setAdaptiveQuality(bool adaptiveQuality);
+		inline bool getAdaptiveQuality() const { return settings.adaptiveQuality; }
+
+		// for live streams: no B-frames, one frame of rate control buffer, slices that fit a
+		// UDP datagram and no muxer buffering, so each frame goes out as soon as it's encoded.
+		// Costs quality at the same bit rate, mainly useful with record(url)
+		void setLowLatency(bool lowLatency);
+		inline bool getLowLatency() const { return settings.lowLatency; }
+
+		// for offline renders and transcodes, where frames come as fast as they can be made:
+		// isFrameDue() is always true and the encoder thread doesn't pace itself to the frame
+		// rate, so the take encodes as fast as the encoder can go.  Motion blur is always offline
+		void setOffline(bool offline);
+		inline bool getOffline() const { return offline; }
+
+		// look for cuts in the content and start a GOP on each one, rather than coding the new
+		// shot as a P-frame and paying for a keyframe a few frames later.  Keyframes are then
+		// only forced every VideoEncoder::SCENE_GOP_SIZE frames otherwise, so files are smaller
+		// and seek points land on shot boundaries.  Compares a sample of the luma rows of
+		// each converted frame, about 0.2ms at 1080p.  Not applied with chunked encoding
+		void setSceneDetection(bool sceneDetection);
+		inline bool getSceneDetection() const { return settings.sceneDetection; }
+
+		// movie recordings only, for events worth seeking to: the next frame added is
+		// encoded as a keyframe, so marks don't need a short GOP across the whole file
+		void markKeyframe();
+		// same, and a chapter called name starts on that frame.  Chapters are written
+		// into the file's index when it's finished, formats like mp4 that write it last keep them
+		void addChapter(const std::string& name);
+
+		// for deliverables with a size cap: while recording every frame gets a quick analysis
+		// pass and is journalled to disk as YUV next to the file (about 1.5 bytes a pixel),
+		// after stop() the journal is encoded again at the bit rate set up or, if
+		// targetFileSize is set, whatever fits that many bytes.  Files only, libav's own
+		// encoders (mpeg4, mpeg2video...), takes precedence over chunked encoding
+		void setTwoPass(bool twoPass, int64_t targetFileSize = 0);
+		inline bool isTwoPass() const { return settings.twoPass; }
+
+		// for offline renders: split the frames into chunks of whole GOPs and encode them on
+		// numWorkers threads (0 for one per core) with an encoder each, then write them into
+		// one file in order.  addFrame() waits once (numWorkers + 1) * chunkFrames frames are
+		// waiting, size memory for that many.  Only for single movie files without audio,
+		// duplicate skipping, adaptive quality and partial frames don't apply.  Needs _THREAD_CAPTURE
+		void setChunkedEncoding(bool chunked, int numWorkers = 0, int chunkFrames = 0);
+		inline bool isChunkedEncoding() const { return settings.chunkedEncoding; }
+
+		// keep one frame out of every stride rendered, played back at the frame rate from
+		// setup().  With accumulate the stride's frames are averaged into the one kept
+		// instead, on a thread of their own, which blurs what moved in between.  Averaging
+		// needs 8 bit components, other formats only keep every stride'th frame.  Pacing is
+		// by frames not time: isFrameDue() is true for every stride'th call, or every call
+		// when accumulating.  A stride of 1 turns it off
+		void setTimeLapse(int stride, bool accumulate = true);
+		inline int getTimeLapseStride() const { return timeLapseStride; }
+
+		// for offline renders: render subFrames frames per movie frame, at the times
+		// getSubFrameTime() gives, and add each one, they're averaged into one frame on a
+		// thread of their own so the next sub-frame can be rendered straight away.  With
+		// supersample > 1 frames are rendered that many times bigger than the recording in
+		// both directions (the format passed to setup()) and box filtered down as they're
+		// averaged.  isFrameDue() is always true, needs 8 bit components and takes precedence
+		// over time-lapses.  setMotionBlur(1) turns it off
+		void setMotionBlur(int subFrames, int supersample = 1);
+		inline bool isMotionBlur() const { return motionBlurSubFrames > 1 || supersample > 1; }
+		// seconds into the recording to render the next sub-frame at, spread evenly over
+		// each frame interval
+		float getSubFrameTime() const;
+
+		// stats for the current or last recording
+		int getNumFramesEncoded() const;
+		// frames not encoded because they repeated the last one
+		int getNumFramesSkipped() const;
+		// frames not encoded to keep up with capture
+		int getNumFramesDropped() const;
+		int getNumAudioSamplesDropped() const;
+		QualityGovernor::Level getQualityLevel() const;
+		// streams only, average seconds from a frame being added to its packet being sent
+		float getStreamLatency() const;
+		// streams only, packets dropped because the network couldn't keep up
+		int getNumPacketsDropped() const;
+
+		// true once a frame interval has passed since the last frame was added
+		bool isFrameDue();
+
+		// borrow one of the exporter's buffers of getFrameSize() bytes to capture or render
+		// straight into, then hand it back with addFrame(), no copies are made after that
+		Frame* getFrame();
+		// takes over the caller's reference, frames added while not recording are just released
+		void addFrame(Frame* frame);
+		// zero copy handoff of a buffer the app owns, release(pixels, userData) is called
+		// from the encoder thread once the frame has been encoded or dropped
+		void addFrame(unsigned char* pixels, FrameReleaseCallback release, void* userData = NULL);
+		// same for formats whose planes aren't stored one after the other
+		void addFrame(unsigned char* const planes[], FrameReleaseCallback release, void* userData = NULL);
+
+		inline int getFrameSize() const { return captureFormat.getSize(); }
+		inline const FrameFormat& getInFormat() const { return captureFormat; }
+		inline int getInWidth() const { return captureFormat.width; }
+		inline int getInHeight() const { return captureFormat.height; }
+		inline int getOutWidth() const { return settings.outW; }
+		inline int getOutHeight() const { return settings.outH; }
+
+		inline Clock* getClock() { return clock; }
+		inline Logger* getLogger() { return logger; }
+		inline ThreadFactory* getThreadFactory() { return threads; }
+
+	private:
+		// a recording that isn't doing anything, creates one if they're all busy
+		Recording* getIdleRecording();
+		// stop() without preparing the next one
+		void stopCurrent();
+		void startStandby();
+		void stopStandby();
+		void updateFrameInterval();
+		// what the recordings get, smaller than what's captured when supersampling
+		void updateRecordingFormat();
+		// hand a frame to whatever is recording
+		void deliverFrame(Frame* frame);
+		// false with a warning if nothing is recording a movie to mark
+		bool canMark();
+
+		Clock* clock;
+		Logger* logger;
+		ThreadFactory* threads;
+
+		// buffers shared by all recordings, each has its own queue
+		FrameQueue framePool;
+		// averages of supersampled frames
+		FrameQueue downscaledPool;
+		// kept around and reused rather than deleted, the audio callback may still
+		// be holding on to the last one
+		std::vector<Recording*> recordings;
+		Recording* volatile current;
+		// the last one started, for the stats
+		Recording* last;
+		// prepared in the background for the next record()
+		Recording* standby;
+		bool warmStandby;
+		// as set, settings.offline is also on while motion blurring
+		bool offline;
+
+		// every frame goes to the image sequence instead when this is set
+		bool imageSequence;
+		volatile bool sequenceRecording;
+		ImageSequence sequence;
+		ImageSequenceSettings sequenceSettings;
+		// or to the GIF
+		bool animatedGif;
+		volatile bool gifRecording;
+		AnimatedGif gif;
+		AnimatedGifSettings gifSettings;
+
+		// frames go through here first when time-lapse averaging or motion blurring
+		FrameAccumulator accumulator;
+		int timeLapseStride;
+		bool timeLapseAccumulate;
+		int motionBlurSubFrames;
+		int supersample;
+		// for this recording, false if the format can't be averaged
+		bool accumulating;
+		int accumulateStride;
+		// isFrameDue() calls, sub-frames added and frames delivered since record()
+		int timeLapseTicks;
+		int numSubFrames;
+		int numOutputFrames;
+		float outputStartTime;
+
+		// marks for the next frame delivered
+		bool pendingKeyframe;
+		std::vector<std::string> pendingChapters;
+
+		// frames as added, settings.inFormat is what the recordings get
+		FrameFormat captureFormat;
+		RecordingSettings settings;
+		float lastFrameTime;
+	};
+
+	inline bool MovieExporter::isRecording() const { return current != NULL || sequenceRecording || gifRecording; }
+}
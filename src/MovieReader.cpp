@@ -0,0 +1,285 @@
+/*
+ *  MovieReader.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "MovieReader.h"
+
+extern "C"
+{
+	#include <imgutils.h>
+}
+
+namespace itg
+{
+	MovieReader::MovieReader(Logger* logger, ThreadFactory* threads) :
+		logger(logger ? logger : getDefaultLogger()),
+		threads(threads ? threads : getDefaultThreadFactory()),
+#ifdef _THREAD_CAPTURE
+		thread(NULL),
+#endif
+		running(false),
+		decoding(false),
+		draining(false),
+		formatCtx(NULL),
+		codecCtx(NULL),
+		decoded(NULL),
+		streamIndex(-1),
+		frames(this->threads),
+		numFramesDecoded(0)
+	{
+		bufferMutex = this->threads->createMutex();
+#ifdef _THREAD_CAPTURE
+		thread = this->threads->createThread();
+#endif
+	}
+
+	MovieReader::~MovieReader()
+	{
+		close();
+#ifdef _THREAD_CAPTURE
+		delete thread;
+#endif
+		delete bufferMutex;
+	}
+
+	bool MovieReader::open(const std::string& filePath)
+	{
+		close();
+		av_register_all();
+
+		if (avformat_open_input(&formatCtx, filePath.c_str(), NULL, NULL) != 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open %s", filePath.c_str());
+			formatCtx = NULL;
+			return false;
+		}
+		if (av_find_stream_info(formatCtx) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not read the streams of %s", filePath.c_str());
+			close();
+			return false;
+		}
+
+		AVCodec* codec = NULL;
+		streamIndex = av_find_best_stream(formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+		if (streamIndex < 0 || !codec)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: %s has no video stream that can be decoded", filePath.c_str());
+			close();
+			return false;
+		}
+		AVCodecContext* ctx = formatCtx->streams[streamIndex]->codec;
+		// decoders that support it spread frames or slices over the cores
+		ctx->thread_count = getNumCores();
+		if (avcodec_open(ctx, codec) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open the %s decoder", codec->name);
+			close();
+			return false;
+		}
+		codecCtx = ctx;
+		decoded = avcodec_alloc_frame();
+
+		format = FrameFormat(codecCtx->width, codecCtx->height, codecCtx->pix_fmt);
+		frames.allocate(format, 0);
+		{
+			ScopedLock lock(bufferMutex);
+			for (int i = 0; i < QUEUE_SIZE; i++)
+			{
+				buffers.push_back(new unsigned char[format.getSize()]);
+			}
+			freeBuffers = buffers;
+		}
+
+		numFramesDecoded = 0;
+		draining = false;
+		running = true;
+		decoding = true;
+#ifdef _THREAD_CAPTURE
+		thread->start(this);
+#endif
+		return true;
+	}
+
+	void MovieReader::close()
+	{
+		running = false;
+#ifdef _THREAD_CAPTURE
+		thread->join();
+#endif
+		decoding = false;
+		// frames nobody read go straight back
+		frames.clear();
+
+		// the exporter may still be encoding some of them
+		while (true)
+		{
+			{
+				ScopedLock lock(bufferMutex);
+				if (freeBuffers.size() == buffers.size()) break;
+			}
+			threads->sleepMillis(1);
+		}
+		for (unsigned i = 0; i < buffers.size(); i++)
+		{
+			delete[] buffers[i];
+		}
+		buffers.clear();
+		freeBuffers.clear();
+
+		if (decoded) av_free(decoded);
+		decoded = NULL;
+		if (codecCtx) avcodec_close(codecCtx);
+		codecCtx = NULL;
+		if (formatCtx) av_close_input_file(formatCtx);
+		formatCtx = NULL;
+		streamIndex = -1;
+	}
+
+	float MovieReader::getFrameRate() const
+	{
+		if (!formatCtx) return 0.f;
+		AVStream* stream = formatCtx->streams[streamIndex];
+		if (stream->r_frame_rate.num && stream->r_frame_rate.den) return av_q2d(stream->r_frame_rate);
+		if (stream->avg_frame_rate.num && stream->avg_frame_rate.den) return av_q2d(stream->avg_frame_rate);
+		return 0.f;
+	}
+
+	Frame* MovieReader::readFrame(bool wait)
+	{
+		while (true)
+		{
+			// decoding is cleared after the last frame is queued so read it before popping
+			bool stillDecoding = decoding;
+			memoryBarrier();
+			Frame* frame = frames.pop();
+			if (frame || !stillDecoding) return frame;
+#ifdef _THREAD_CAPTURE
+			if (!wait) return NULL;
+			threads->sleepMillis(1);
+#else
+			if (!decodeNext()) decoding = false;
+#endif
+		}
+	}
+
+	bool MovieReader::isFinished()
+	{
+		return !decoding && frames.empty();
+	}
+
+// PRIVATE
+
+#ifdef _THREAD_CAPTURE
+	void MovieReader::run()
+	{
+		while (decodeNext());
+		memoryBarrier();
+		decoding = false;
+	}
+#endif
+
+	bool MovieReader::decodeNext()
+	{
+		AVPacket packet;
+		while (running)
+		{
+			if (!draining)
+			{
+				if (av_read_frame(formatCtx, &packet) >= 0)
+				{
+					bool queued = packet.stream_index == streamIndex && decodePacket(&packet);
+					av_free_packet(&packet);
+					if (queued) return true;
+					continue;
+				}
+				draining = true;
+			}
+			// empty packets flush out the frames the decoder is holding back
+			av_init_packet(&packet);
+			packet.data = NULL;
+			packet.size = 0;
+			return decodePacket(&packet);
+		}
+		return false;
+	}
+
+	bool MovieReader::decodePacket(AVPacket* packet)
+	{
+		int gotPicture = 0;
+		if (avcodec_decode_video2(codecCtx, decoded, &gotPicture, packet) < 0)
+		{
+			logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Error decoding frame %d", numFramesDecoded);
+			return false;
+		}
+		if (!gotPicture) return false;
+
+		unsigned char* pixels = acquireBuffer();
+		if (!pixels) return false;
+		// the decoder reuses its own buffers, and pads their rows
+		unsigned char* planes[FrameFormat::MAX_PLANES];
+		format.fillPlanes(pixels, planes);
+		av_image_copy(planes, format.strides, (const uint8_t**)decoded->data, decoded->linesize, format.pixelFormat, format.width, format.height);
+		frames.push(frames.wrap(planes, &MovieReader::bufferReleased, this));
+		numFramesDecoded++;
+		return true;
+	}
+
+	unsigned char* MovieReader::acquireBuffer()
+	{
+		while (running)
+		{
+			{
+				ScopedLock lock(bufferMutex);
+				if (!freeBuffers.empty())
+				{
+					unsigned char* pixels = freeBuffers.back();
+					freeBuffers.pop_back();
+					return pixels;
+				}
+			}
+#ifdef _THREAD_CAPTURE
+			threads->sleepMillis(1);
+#else
+			// without threads only the caller can be holding on to them
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: All %d decoded frames are still in use, release them before reading more", QUEUE_SIZE);
+			return NULL;
+#endif
+		}
+		return NULL;
+	}
+
+	void MovieReader::bufferReleased(unsigned char* pixels, void* userData)
+	{
+		MovieReader* reader = (MovieReader*)userData;
+		ScopedLock lock(reader->bufferMutex);
+		reader->freeBuffers.push_back(pixels);
+	}
+}
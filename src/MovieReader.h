@@ -0,0 +1,114 @@
+/*
+ *  MovieReader.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+
+namespace itg
+{
+	// decodes the video of an existing movie into frames for MovieExporter::addFrame(), for
+	// transcoding and for running the exporter without anything to capture from.  Frames
+	// come out in the decoder's own pixel format, usually YUV420P, so they go straight to
+	// the encoder without a round trip through RGB.  Decoding runs on a thread of its own
+	// a few frames ahead, it waits once QUEUE_SIZE frames are queued or still being encoded
+	class MovieReader
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		// decoded frames that can be waiting for or in the exporter at once
+		static const int QUEUE_SIZE = 8;
+
+		// anything left NULL falls back to the OS implementations in ExporterPlatform.h
+		MovieReader(Logger* logger = NULL, ThreadFactory* threads = NULL);
+		~MovieReader();
+
+		// opens the first video stream of filePath and starts decoding it
+		bool open(const std::string& filePath);
+		// waits for the exporter to release every frame it was given, so call it once the
+		// recording they went to has finished
+		void close();
+		inline bool isOpen() const { return formatCtx != NULL; }
+
+		// how the frames are laid out, pass it to MovieExporter::setup()
+		inline const FrameFormat& getFormat() const { return format; }
+		// the stream's nominal rate, 0 if the file doesn't say
+		float getFrameRate() const;
+
+		// the next frame with one reference for the caller, NULL once the whole stream has
+		// been read.  Without wait NULL is also returned while the next frame isn't ready
+		Frame* readFrame(bool wait = true);
+		// every frame has been decoded and read
+		bool isFinished();
+		inline int getNumFramesDecoded() const { return numFramesDecoded; }
+
+	private:
+#ifdef _THREAD_CAPTURE
+		void run();
+#endif
+		// decode until one frame has been queued, false at the end of the stream
+		bool decodeNext();
+		bool decodePacket(AVPacket* packet);
+		// a buffer nothing is using, NULL if it's stopped before one comes back
+		unsigned char* acquireBuffer();
+		// release callback of the queued frames, from whichever thread releases them last
+		static void bufferReleased(unsigned char* pixels, void* userData);
+
+		Logger* logger;
+		ThreadFactory* threads;
+#ifdef _THREAD_CAPTURE
+		Thread* thread;
+#endif
+		volatile bool running;
+		volatile bool decoding;
+		// the end of the file has been reached, only the decoder's delayed frames are left
+		bool draining;
+
+		AVFormatContext* formatCtx;
+		AVCodecContext* codecCtx;
+		AVFrame* decoded;
+		int streamIndex;
+		FrameFormat format;
+
+		// decoded frames in order, wrapping the buffers below
+		FrameQueue frames;
+		std::vector<unsigned char*> buffers;
+		std::vector<unsigned char*> freeBuffers;
+		Mutex* bufferMutex;
+		volatile int numFramesDecoded;
+	};
+}
@@ -0,0 +1,188 @@
+/*
+ *  Muxer.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "Muxer.h"
+
+#include <cstring>
+
+namespace itg
+{
+	Muxer::Muxer(Logger* logger) :
+		logger(logger), outputFormat(NULL), formatCtx(NULL), opened(false), copiedStreams(false)
+	{
+	}
+
+	Muxer::~Muxer()
+	{
+		close();
+	}
+
+	bool Muxer::setup(const std::string& container, CodecID videoCodecId)
+	{
+		close();
+
+		////////////////////////////////////////////////////////////
+		// auto detect the output format from the name. default is mpeg.
+		std::string name = "amovie." + container;
+		outputFormat = av_guess_format(NULL, name.c_str(), NULL);
+		if (!outputFormat)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not guess output container for an %s file (ueuur!!)", container.c_str());
+			return false;
+		}
+		// set the format codec (the format also has a default codec that can be read from it)
+		outputFormat->video_codec = videoCodecId;
+
+		/////////////////////////////////////////////////////////////
+		// allocate the format context
+		formatCtx = avformat_alloc_context();
+		if (!formatCtx)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not allocate format context");
+			return false;
+		}
+		formatCtx->oformat = outputFormat;
+		return true;
+	}
+
+	AVStream* Muxer::addVideoStream()
+	{
+		return av_new_stream(formatCtx, formatCtx->nb_streams);
+	}
+
+	AVStream* Muxer::addAudioStream(CodecID audioCodecId)
+	{
+		outputFormat->audio_codec = audioCodecId;
+		return av_new_stream(formatCtx, formatCtx->nb_streams);
+	}
+
+	AVStream* Muxer::addStreamCopy(AVStream* source)
+	{
+		AVStream* stream = av_new_stream(formatCtx, formatCtx->nb_streams);
+		if (!stream || avcodec_copy_context(stream->codec, source->codec) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not copy stream parameters");
+			return NULL;
+		}
+		stream->time_base = source->time_base;
+		copiedStreams = true;
+		return stream;
+	}
+
+	bool Muxer::setParameters()
+	{
+		// set the output parameters (must be done even if no parameters).
+		if (av_set_parameters(formatCtx, NULL) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not set format parameters");
+			return false;
+		}
+		return true;
+	}
+
+	bool Muxer::needsGlobalHeader() const
+	{
+		return !strcmp(formatCtx->oformat->name, "mp4") || !strcmp(formatCtx->oformat->name, "mov") || !strcmp(formatCtx->oformat->name, "3gp");
+	}
+
+	bool Muxer::open(const std::string& filePath)
+	{
+		// open the output file
+		if (url_fopen(&formatCtx->pb, filePath.c_str(), URL_WRONLY) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open file %s", filePath.c_str());
+			return false;
+		}
+		opened = true;
+
+		// write the stream header, if any
+		av_write_header(formatCtx);
+		return true;
+	}
+
+	void Muxer::writePacket(AVPacket* pkt)
+	{
+		av_interleaved_write_frame(formatCtx, pkt);
+	}
+
+	void Muxer::flush()
+	{
+		if (opened) avio_flush(formatCtx->pb);
+	}
+
+	void Muxer::addChapter(const std::string& title, AVRational timeBase, int64_t start, int64_t end)
+	{
+		AVChapter* chapter = (AVChapter*)av_mallocz(sizeof(AVChapter));
+		if (!chapter) return;
+		chapter->id = formatCtx->nb_chapters;
+		chapter->time_base = timeBase;
+		chapter->start = start;
+		chapter->end = end;
+		av_dict_set(&chapter->metadata, "title", title.c_str(), 0);
+		av_dynarray_add(&formatCtx->chapters, (int*)&formatCtx->nb_chapters, chapter);
+	}
+
+	void Muxer::finish()
+	{
+		if (opened) av_write_trailer(formatCtx);
+	}
+
+	bool Muxer::isStreamUrl(const std::string& filePath)
+	{
+		return filePath.find("://") != std::string::npos && filePath.compare(0, 7, "file://") != 0;
+	}
+
+	void Muxer::close()
+	{
+		if (!formatCtx) return;
+
+		if (opened) url_fclose(formatCtx->pb);
+		opened = false;
+
+		for (unsigned i = 0; i < formatCtx->nb_streams; i++)
+		{
+			// encoders free their own
+			if (copiedStreams) av_freep(&formatCtx->streams[i]->codec->extradata);
+			av_freep(&formatCtx->streams[i]->codec);
+			av_freep(&formatCtx->streams[i]);
+		}
+		for (unsigned i = 0; i < formatCtx->nb_chapters; i++)
+		{
+			av_dict_free(&formatCtx->chapters[i]->metadata);
+			av_freep(&formatCtx->chapters[i]);
+		}
+		av_freep(&formatCtx->chapters);
+		av_free(formatCtx);
+		formatCtx = NULL;
+		outputFormat = NULL;
+		copiedStreams = false;
+	}
+}
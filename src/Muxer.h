@@ -0,0 +1,95 @@
+/*
+ *  Muxer.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+
+namespace itg
+{
+	// where encoded packets end up, a muxer or something that muxes them in its own way
+	class PacketSink
+	{
+	public:
+		virtual ~PacketSink() {}
+		virtual void writePacket(AVPacket* pkt) = 0;
+		virtual void flush() = 0;
+	};
+
+	// owns the container side of a recording: format context, streams and the output file
+	class Muxer : public PacketSink
+	{
+	public:
+		Muxer(Logger* logger);
+		~Muxer();
+
+		// auto detect the output format from the container name and allocate the format context
+		bool setup(const std::string& container, CodecID videoCodecId);
+		AVStream* addVideoStream();
+		AVStream* addAudioStream(CodecID audioCodecId);
+		// a stream with the same codec parameters as one being encoded for another muxer
+		AVStream* addStreamCopy(AVStream* source);
+		// must be called after the streams' codec contexts are configured
+		bool setParameters();
+		// some formats want stream headers to be seperate
+		bool needsGlobalHeader() const;
+
+		// open the file and write the stream header, if any.  filePath can also be a
+		// URL of any protocol libav was built with, udp:// or rtmp:// for example
+		bool open(const std::string& filePath);
+		// packets are interleaved by dts across streams, pts/dts must be in the stream's time base
+		void writePacket(AVPacket* pkt);
+		// push out whatever is buffered in the IO context, for streams
+		void flush();
+		// a chapter from start to end, in timeBase units.  Call before finish(), only formats
+		// that write their index in the trailer (mp4) store chapters added this late
+		void addChapter(const std::string& title, AVRational timeBase, int64_t start, int64_t end);
+		// write the trailer, call before closing the codecs
+		void finish();
+		// close the file and free the format context and its streams
+		void close();
+
+		inline AVFormatContext* getFormatContext() { return formatCtx; }
+		// a network stream rather than a file
+		static bool isStreamUrl(const std::string& filePath);
+		inline bool isOpen() const { return opened; }
+
+	private:
+		Logger* logger;
+		AVOutputFormat* outputFormat;
+		AVFormatContext* formatCtx;
+		bool opened;
+		// the streams' codec contexts are copies, whose extradata is ours to free
+		bool copiedStreams;
+	};
+}
@@ -0,0 +1,72 @@
+/*
+ *  QualityGovernor.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "QualityGovernor.h"
+
+namespace itg
+{
+	QualityGovernor::QualityGovernor() :
+		level(LEVEL_FULL), frameInterval(0.f), averageTime(-1.f), framesSinceChange(0)
+	{
+	}
+
+	void QualityGovernor::reset(float frameInterval)
+	{
+		this->frameInterval = frameInterval;
+		level = LEVEL_FULL;
+		averageTime = -1.f;
+		framesSinceChange = 0;
+	}
+
+	bool QualityGovernor::update(float encodeTime, int queueDepth)
+	{
+		// smooth out the odd slow frame, keyframes take a lot longer than the rest
+		averageTime = averageTime < 0.f ? encodeTime : .9f * averageTime + .1f * encodeTime;
+		framesSinceChange++;
+
+		bool behind = queueDepth >= HIGH_QUEUE_DEPTH || averageTime > .95f * frameInterval;
+		bool headroom = queueDepth <= LOW_QUEUE_DEPTH && averageTime < .5f * frameInterval;
+
+		if (behind && level < NUM_LEVELS - 1 && framesSinceChange >= STEP_DOWN_FRAMES)
+		{
+			level = (Level)(level + 1);
+			framesSinceChange = 0;
+			return true;
+		}
+		if (headroom && level > LEVEL_FULL && framesSinceChange >= STEP_UP_FRAMES)
+		{
+			level = (Level)(level - 1);
+			framesSinceChange = 0;
+			return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ *  QualityGovernor.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+namespace itg
+{
+	// decides how much quality to give up when the encoder thread can't keep up with
+	// capture, from how long frames take to encode and how many are waiting.  It only
+	// picks the level, each Recording turns that into scaler, encoder and frame rate settings
+	class QualityGovernor
+	{
+	public:
+		// each level keeps the savings of the ones before it
+		enum Level
+		{
+			LEVEL_FULL,
+			LEVEL_BILINEAR_SCALER,
+			LEVEL_FAST_BILINEAR_SCALER,
+			LEVEL_FAST_MOTION_SEARCH,
+			LEVEL_HALF_FRAME_RATE,
+			LEVEL_THIRD_FRAME_RATE,
+			NUM_LEVELS
+		};
+
+		// queued frames that count as falling behind, and as having caught up
+		static const int HIGH_QUEUE_DEPTH = 8;
+		static const int LOW_QUEUE_DEPTH = 1;
+		// frames to wait after a change before stepping down again or back up, up is slower
+		// so a level that only just copes isn't left straight away
+		static const int STEP_DOWN_FRAMES = 15;
+		static const int STEP_UP_FRAMES = 90;
+
+		QualityGovernor();
+
+		// frameInterval is the time between captured frames, the budget for encoding one
+		void reset(float frameInterval);
+		// call after each frame with how long it took, returns true if the level changed
+		bool update(float encodeTime, int queueDepth);
+
+		inline Level getLevel() const { return level; }
+
+	private:
+		Level level;
+		float frameInterval;
+		float averageTime;
+		int framesSinceChange;
+	};
+}
@@ -0,0 +1,710 @@
+/*
+ *  Recording.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "Recording.h"
+
+#include <algorithm>
+
+namespace itg
+{
+	RecordingSettings::RecordingSettings() :
+		outW(0), outH(0),
+		bitRate(4000000),
+		frameRate(25),
+		codecId(CODEC_ID_MPEG4),
+		frameInterval(.04f),
+		audioEnabled(false),
+		sampleRate(44100),
+		numChannels(2),
+		audioCodecId(CODEC_ID_AAC),
+		audioBitRate(128000),
+		audioFifoSeconds(2),
+		skipDuplicateFrames(false),
+		adaptiveQuality(false),
+		lowLatency(false),
+		offline(false),
+		sceneDetection(false),
+		twoPass(false),
+		targetFileSize(0),
+		chunkedEncoding(false),
+		chunkWorkers(0),
+		chunkFrames(0),
+		finished(NULL),
+		finishedUserData(NULL)
+	{
+	}
+
+	Recording::Recording(Clock* clock, Logger* logger, ThreadFactory* threads) :
+		clock(clock),
+		logger(logger),
+		threads(threads),
+		frameQueue(threads),
+#ifdef _THREAD_CAPTURE
+		thread(NULL),
+		threadRunning(false),
+		keepAlive(false),
+		prepared(false),
+		prepareFailed(false),
+		chunks(logger, threads),
+		chunked(false),
+#endif
+		recording(false),
+		frameNum(0),
+		recordStartTime(0.f),
+		frameTime(0.f),
+		lastVideoPts(-1),
+		numFramesSkipped(0),
+		lastFrameHash(0),
+		pendingKeyframe(false),
+		pendingSkipPts(-1),
+		qualityLevel(QualityGovernor::LEVEL_FULL),
+		frameDecimation(1),
+		numFramesDropped(0),
+		outFrameValid(false),
+		partialFramesSeen(false),
+		audioStartTime(0.f),
+		audioStarted(false),
+		audioSamplesDropped(0),
+		twoPassEncoder(logger),
+		twoPassActive(false),
+		scaleFlags(SWS_BICUBIC)
+	{
+#ifdef _THREAD_CAPTURE
+		thread = threads->createThread();
+#endif
+	}
+
+	Recording::~Recording()
+	{
+		stop();
+#ifdef _THREAD_CAPTURE
+		cancel();
+		delete thread;
+#endif
+		for (unsigned i = 0; i < outputs.size(); i++)
+		{
+			delete outputs[i];
+		}
+	}
+
+	bool Recording::prepare(const RecordingSettings& settings)
+	{
+		this->settings = settings;
+		// the scaler from the last take still fits most of the time
+		if (converter.getInFormat() != settings.inFormat || converter.getOutWidth() != settings.outW || converter.getOutHeight() != settings.outH)
+		{
+			converter.setup(settings.inFormat, settings.outW, settings.outH, PIX_FMT_YUV420P, SWS_BICUBIC);
+		}
+		if (settings.audioEnabled)
+		{
+			audioFifo.allocate(settings.audioFifoSeconds * settings.sampleRate * settings.numChannels);
+			audioBuffer.resize(AudioEncoder::DEFAULT_FRAME_SIZE * 4 * settings.numChannels);
+		}
+		if (!initEncoder())
+		{
+			closeEncoder();
+			return false;
+		}
+		return true;
+	}
+
+	bool Recording::start(const std::string& filePath)
+	{
+		if (recording) return false;
+		this->filePath = filePath;
+#ifdef _THREAD_CAPTURE
+		if (threadRunning)
+		{
+			// prepared in the background, the encoder thread opens the file
+			startRecord();
+			return true;
+		}
+#endif
+		if (!openFiles())
+		{
+			closeEncoder();
+			return false;
+		}
+		resetEncoderState();
+		startRecord();
+#ifdef _THREAD_CAPTURE
+		keepAlive = false;
+		threadRunning = true;
+		thread->start(this);
+#endif
+		return true;
+	}
+
+	void Recording::stop()
+	{
+		if (!recording) return;
+		recording = false;
+#ifndef _THREAD_CAPTURE
+		finishRecord(true);
+#endif
+	}
+
+#ifdef _THREAD_CAPTURE
+	void Recording::prepareInBackground(const RecordingSettings& settings)
+	{
+		thread->join();
+		this->settings = settings;
+		prepared = false;
+		prepareFailed = false;
+		keepAlive = true;
+		threadRunning = true;
+		thread->start(this);
+	}
+
+	bool Recording::waitUntilPrepared()
+	{
+		while (!prepared && !prepareFailed) threads->sleepMillis(1);
+		return prepared;
+	}
+
+	void Recording::cancel()
+	{
+		keepAlive = false;
+		memoryBarrier();
+		thread->join();
+	}
+#endif
+
+	bool Recording::isIdle()
+	{
+#ifdef _THREAD_CAPTURE
+		return !recording && !threadRunning;
+#else
+		return !recording;
+#endif
+	}
+
+	void Recording::join()
+	{
+#ifdef _THREAD_CAPTURE
+		thread->join();
+#endif
+	}
+
+	void Recording::addFrame(Frame* frame)
+	{
+		if (!recording)
+		{
+			frame->release();
+			return;
+		}
+#ifdef _THREAD_CAPTURE
+		// offline, the capture waits for the workers rather than piling frames up in memory
+		while (chunked && recording && frameQueue.size() + chunks.getNumFramesWaiting() >= chunks.getMaxFramesWaiting())
+		{
+			threads->sleepMillis(1);
+		}
+		frameQueue.push(frame);
+#else
+		processFrame(frame);
+		frame->release();
+		encodeAudio(false);
+#endif
+	}
+
+	float Recording::getStreamLatency() const
+	{
+		return outputs.empty() ? 0.f : outputs[0]->getStreamLatency();
+	}
+
+	int Recording::getNumPacketsDropped() const
+	{
+		return outputs.empty() ? 0 : outputs[0]->getNumPacketsDropped();
+	}
+
+	void Recording::addAudioSamples(const float* samples, int numFrames)
+	{
+		if (!recording || !settings.audioEnabled) return;
+
+		if (!audioStarted)
+		{
+			// the callback comes once the buffer is full so it started this long ago
+			audioStartTime = clock->getElapsedTimef() - (float)numFrames / (float)settings.sampleRate;
+			memoryBarrier();
+			audioStarted = true;
+		}
+
+		// only whole frames so the channels never get out of step
+		int free = audioFifo.getFree() / settings.numChannels;
+		int count = numFrames < free ? numFrames : free;
+		audioFifo.write(samples, count * settings.numChannels);
+		if (count < numFrames) audioSamplesDropped += (numFrames - count) * settings.numChannels;
+	}
+
+// PRIVATE
+
+	// capture side state, on the thread calling start()
+	void Recording::startRecord()
+	{
+		audioFifo.reset();
+		audioStarted = false;
+		audioSamplesDropped = 0;
+		recordStartTime = clock->getElapsedTimef();
+		memoryBarrier();
+		recording = true;
+	}
+
+	// encoder side state, on whichever thread opened the file
+	void Recording::resetEncoderState()
+	{
+		frameNum = 0;
+		lastVideoPts = -1;
+		numFramesSkipped = 0;
+		lastFrameHash = 0;
+		sceneDetector.reset();
+		chapters.clear();
+		pendingChapters.clear();
+		pendingKeyframe = false;
+		pendingSkipPts = -1;
+		outFrameValid = false;
+		partialFramesSeen = false;
+		numFramesDropped = 0;
+		governor.reset(settings.frameInterval);
+		applyQualityLevel(QualityGovernor::LEVEL_FULL);
+
+		OutputSettings master(settings.outW, settings.outH, settings.bitRate, settings.codecId, settings.container);
+		master.gopSize = getGopSize();
+		if (settings.sceneDetection && outputs[0]->isStreaming()) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Scene detection makes GOPs up to %d frames long, receivers joining the stream may wait that long for a picture", VideoEncoder::SCENE_GOP_SIZE);
+		twoPassActive = false;
+		if (settings.twoPass)
+		{
+			if (outputs[0]->isStreaming()) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Streams can't be encoded in two passes, encoding once instead");
+			else twoPassActive = twoPassEncoder.start(master, settings.frameRate, filePath);
+		}
+#ifdef _THREAD_CAPTURE
+		chunked = !twoPassActive && canEncodeChunks() &&
+			chunks.start(settings.inFormat, master, outputs[0]->getEncoder().getCodecContext(), settings.frameRate, settings.chunkWorkers, settings.chunkFrames);
+#endif
+	}
+
+#ifdef _THREAD_CAPTURE
+	bool Recording::canEncodeChunks()
+	{
+		if (!settings.chunkedEncoding) return false;
+		if (settings.audioEnabled || !settings.renditions.empty() || outputs[0]->isStreaming())
+		{
+			logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Chunked encoding only works for a single movie file without audio, encoding the frames in order instead");
+			return false;
+		}
+		return true;
+	}
+#endif
+
+	void Recording::closeEncoder()
+	{
+		for (unsigned i = 0; i < outputs.size(); i++)
+		{
+			outputs[i]->close();
+		}
+	}
+
+	bool Recording::openFiles()
+	{
+		for (unsigned i = 0; i < outputs.size(); i++)
+		{
+			if (!outputs[i]->open(getOutputPath(i))) return false;
+		}
+		return true;
+	}
+
+	// renditions go next to the master with their suffix and container
+	std::string Recording::getOutputPath(int output) const
+	{
+		if (output == 0) return filePath;
+		const OutputSettings& rendition = settings.renditions[output - 1];
+		std::string base = filePath;
+		size_t dot = base.find_last_of('.');
+		size_t slash = base.find_last_of("/\\");
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) base = base.substr(0, dot);
+		// HLS renditions get playlists of their own
+		if (HlsSegmenter::isPlaylistPath(filePath)) return base + rendition.fileSuffix + ".m3u8";
+		return base + rendition.fileSuffix + "." + rendition.container;
+	}
+
+	void Recording::finishRecord(bool succeeded)
+	{
+		if (succeeded)
+		{
+			if (settings.audioEnabled) encodeAudio(true);
+
+			// the movie ended on repeated frames, show the last one until the end
+			if (pendingSkipPts >= 0) writeVideo(pendingSkipPts);
+			writeChapters();
+#ifdef _THREAD_CAPTURE
+			if (chunked) chunks.finish(outputs[0]);
+#endif
+			if (twoPassActive && !twoPassEncoder.finish(outputs[0], settings.targetFileSize, settings.audioEnabled ? settings.audioBitRate : 0))
+			{
+				succeeded = false;
+			}
+
+			for (unsigned i = 0; i < outputs.size(); i++)
+			{
+				outputs[i]->finish();
+			}
+		}
+
+#ifdef _THREAD_CAPTURE
+		chunks.cancel();
+		chunked = false;
+#endif
+		twoPassEncoder.cancel();
+		twoPassActive = false;
+		// free the encoder
+		closeEncoder();
+
+		if (settings.finished)
+		{
+			for (unsigned i = 0; i < outputs.size(); i++)
+			{
+				settings.finished(getOutputPath(i), succeeded, settings.finishedUserData);
+			}
+		}
+	}
+
+#ifdef _THREAD_CAPTURE
+	void Recording::run()
+	{
+		while (threadRunning)
+		{
+			// prepared in the background, open the encoder before anyone asks for it
+			if (keepAlive && !prepared)
+			{
+				if (!prepare(settings))
+				{
+					logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not prepare encoder in the background");
+					prepareFailed = true;
+					threadRunning = false;
+					break;
+				}
+				memoryBarrier();
+				prepared = true;
+			}
+
+			if (!outputs.empty() && !outputs[0]->isOpen())
+			{
+				if (recording)
+				{
+					// start() was called, everything but the file is ready
+					memoryBarrier();
+					if (openFiles()) resetEncoderState();
+					else
+					{
+						recording = false;
+						while (Frame* frame = frameQueue.pop()) frame->release();
+						finishRecord(false);
+						threadRunning = false;
+					}
+				}
+				else if (!keepAlive)
+				{
+					// cancelled before it was started
+					closeEncoder();
+					threadRunning = false;
+				}
+				else threads->sleepMillis(1);
+				continue;
+			}
+
+			if (chunked) chunks.writeFinished(outputs[0]);
+
+			Frame* frame = frameQueue.pop();
+			if (frame && chunked)
+			{
+				// converted and encoded by the workers, as fast as they can.  Chunks start
+				// on fixed GOPs, so only the chapters of the marks apply
+				takeMarks(frame);
+				for (unsigned i = 0; i < pendingChapters.size(); i++)
+				{
+					Chapter chapter = { pendingChapters[i], frameNum };
+					chapters.push_back(chapter);
+				}
+				pendingChapters.clear();
+				pendingKeyframe = false;
+				frameNum++;
+				chunks.addFrame(frame);
+			}
+			else if (frame)
+			{
+				float start = clock->getElapsedTimef();
+
+				bool encoded = processFrame(frame);
+				frame->release();
+				if (settings.audioEnabled) encodeAudio(false);
+
+				// only pace when there's nothing to catch up on, skipped frames never wait
+				float elapsed = clock->getElapsedTimef() - start;
+				if (!settings.offline && encoded && frameQueue.empty() && elapsed < settings.frameInterval) threads->sleepMillis(1000.f * (settings.frameInterval - elapsed));
+			}
+			// recording is cleared after the last frame is queued so check the queue again
+			else if (!recording && frameQueue.empty())
+			{
+				finishRecord(true);
+				threadRunning = false;
+			}
+			else
+			{
+				if (settings.audioEnabled) encodeAudio(false);
+				threads->sleepMillis(1);
+			}
+		}
+	}
+#endif
+
+	bool Recording::processFrame(Frame* frame)
+	{
+		float start = clock->getElapsedTimef();
+		bool encoded = encodeFrame(frame);
+		// skipped and dropped frames cost next to nothing and would hide an encoder that's behind
+		if (encoded && settings.adaptiveQuality && governor.update(clock->getElapsedTimef() - start, frameQueue.size()))
+		{
+			QualityGovernor::Level level = governor.getLevel();
+			logger->log(EXPORTER_LOG_NOTICE, "ofxMovieExporter: Encoder %s, quality level %d", level > qualityLevel ? "falling behind" : "caught up", (int)level);
+			applyQualityLevel(level);
+		}
+		return encoded;
+	}
+
+	void Recording::applyQualityLevel(QualityGovernor::Level level)
+	{
+		qualityLevel = level;
+		int flags = SWS_BICUBIC;
+		if (level >= QualityGovernor::LEVEL_FAST_BILINEAR_SCALER) flags = SWS_FAST_BILINEAR;
+		else if (level >= QualityGovernor::LEVEL_BILINEAR_SCALER) flags = SWS_BILINEAR;
+		converter.setFlags(flags);
+		scaleFlags = flags;
+		for (unsigned i = 0; i < outputs.size(); i++)
+		{
+			outputs[i]->getEncoder().setFastMotionSearch(level >= QualityGovernor::LEVEL_FAST_MOTION_SEARCH);
+		}
+		frameDecimation = 1;
+		if (level >= QualityGovernor::LEVEL_THIRD_FRAME_RATE) frameDecimation = 3;
+		else if (level >= QualityGovernor::LEVEL_HALF_FRAME_RATE) frameDecimation = 2;
+	}
+
+	bool Recording::encodeFrame(Frame* frame)
+	{
+		takeMarks(frame);
+		bool partial = frame->isPartial() && outFrameValid && converter.canConvertRows();
+		if (frame->isPartial()) partialFramesSeen = true;
+		frameTime = frame->time;
+
+		int64_t pts = frameNum;
+		if (settings.audioEnabled)
+		{
+			// same clock as the audio, frames that land in the same slot as the last one are dropped
+			pts = (int64_t)((frame->time - recordStartTime) * settings.frameRate + .5f);
+			if (pts <= lastVideoPts)
+			{
+				skipFrame(frame, partial);
+				return false;
+			}
+		}
+		lastVideoPts = pts;
+		frameNum++;
+
+		// lower frame rate, the last encoded frame is shown for longer
+		if (frameDecimation > 1 && frameNum % frameDecimation != 1)
+		{
+			skipFrame(frame, partial);
+			pendingSkipPts = pts;
+			numFramesDropped++;
+			return false;
+		}
+
+		if (partial)
+		{
+			// nothing we could compare a hash with next time
+			lastFrameHash = 0;
+			if (settings.skipDuplicateFrames && frame->getDirtyRects().empty())
+			{
+				pendingSkipPts = pts;
+				numFramesSkipped++;
+				return false;
+			}
+			convertDirtyRows(frame);
+			writeVideo(pts);
+			return true;
+		}
+
+		if (frame->isPartial() && !outFrameValid)
+		{
+			logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Frame only has dirty rects but there's no complete frame to update, converting all of it");
+		}
+
+		if (settings.skipDuplicateFrames)
+		{
+			uint64_t hash = hashFrame(settings.inFormat, frame->planes);
+			if (hash == lastFrameHash)
+			{
+				pendingSkipPts = pts;
+				numFramesSkipped++;
+				return false;
+			}
+			lastFrameHash = hash;
+		}
+
+		converter.convert(frame->planes, outputs[0]->getFrame());
+		outFrameValid = true;
+		writeVideo(pts);
+		return true;
+	}
+
+	// frames that aren't encoded still have to go into the master frame when partial frames may
+	// follow, otherwise the next one is drawn on top of stale pixels
+	void Recording::skipFrame(Frame* frame, bool partial)
+	{
+		if (partial) convertDirtyRows(frame);
+		else if (partialFramesSeen)
+		{
+			converter.convert(frame->planes, outputs[0]->getFrame());
+			outFrameValid = true;
+		}
+	}
+
+	void Recording::convertDirtyRows(Frame* frame)
+	{
+		frame->getDirtyBands(settings.inFormat.height, dirtyBands);
+		for (unsigned i = 0; i < dirtyBands.size(); i++)
+		{
+			if (!dirtyBands[i]) continue;
+			int y = i * Frame::DIRTY_BAND_HEIGHT;
+			converter.convertRows(frame->planes, outputs[0]->getFrame(), y, std::min(Frame::DIRTY_BAND_HEIGHT, settings.inFormat.height - y));
+		}
+	}
+
+	// encodes whatever is in the master's frame, into every output
+	void Recording::writeVideo(int64_t pts)
+	{
+		pendingSkipPts = -1;
+		// marked frames that were skipped or dropped carry over to this one
+		bool keyframe = pendingKeyframe;
+		pendingKeyframe = false;
+		for (unsigned i = 0; i < pendingChapters.size(); i++)
+		{
+			Chapter chapter = { pendingChapters[i], pts };
+			chapters.push_back(chapter);
+		}
+		pendingChapters.clear();
+		if (settings.sceneDetection)
+		{
+			AVFrame* master = outputs[0]->getFrame();
+			// still run on marked frames so the next one is compared with this
+			if (sceneDetector.isCut(master->data[0], master->linesize[0], settings.outW, settings.outH)) keyframe = true;
+		}
+		if (twoPassActive) twoPassEncoder.addFrame(outputs[0]->getFrame(), pts, keyframe);
+		else outputs[0]->encodeVideo(pts, frameTime, keyframe);
+		for (unsigned i = 1; i < outputs.size(); i++)
+		{
+			// cascade from the previous output, it's smaller than the master so cheaper to scale
+			RecordingOutput* source = outputs[i - 1];
+			if (source->getWidth() < outputs[i]->getWidth() || source->getHeight() < outputs[i]->getHeight()) source = outputs[0];
+			outputs[i]->scaleFrom(source, scaleFlags);
+			// renditions cut where the master does so they can be switched between there
+			outputs[i]->encodeVideo(pts, frameTime, keyframe);
+		}
+	}
+
+	void Recording::takeMarks(Frame* frame)
+	{
+		if (frame->keyframe) pendingKeyframe = true;
+		pendingChapters.insert(pendingChapters.end(), frame->chapters.begin(), frame->chapters.end());
+	}
+
+	// each one runs until the next, the last to the end of the movie
+	void Recording::writeChapters()
+	{
+		int64_t end = std::max(lastVideoPts + 1, (int64_t)frameNum);
+		for (unsigned i = 0; i < chapters.size(); i++)
+		{
+			int64_t chapterEnd = i + 1 < chapters.size() ? chapters[i + 1].start : end;
+			for (unsigned j = 0; j < outputs.size(); j++)
+			{
+				outputs[j]->addChapter(chapters[i].title, chapters[i].start, chapterEnd);
+			}
+		}
+	}
+
+	int Recording::getGopSize() const
+	{
+		return settings.sceneDetection ? VideoEncoder::SCENE_GOP_SIZE : VideoEncoder::GOP_SIZE;
+	}
+
+	void Recording::encodeAudio(bool flush)
+	{
+		if (!audioStarted) return;
+		memoryBarrier();
+
+		int read;
+		while ((read = audioFifo.read(&audioBuffer[0], audioBuffer.size())) > 0)
+		{
+			for (unsigned i = 0; i < outputs.size(); i++)
+			{
+				outputs[i]->addAudioSamples(&audioBuffer[0], read / settings.numChannels);
+			}
+		}
+
+		for (unsigned i = 0; i < outputs.size(); i++)
+		{
+			outputs[i]->encodeAudio(flush, audioStartTime - recordStartTime);
+		}
+	}
+
+	bool Recording::initEncoder()
+	{
+		unsigned numOutputs = 1 + settings.renditions.size();
+		while (outputs.size() > numOutputs)
+		{
+			delete outputs.back();
+			outputs.pop_back();
+		}
+		while (outputs.size() < numOutputs) outputs.push_back(new RecordingOutput(clock, logger, threads));
+
+		for (unsigned i = 0; i < numOutputs; i++)
+		{
+			OutputSettings output = i == 0 ?
+				OutputSettings(settings.outW, settings.outH, settings.bitRate, settings.codecId, settings.container) :
+				settings.renditions[i - 1];
+			output.lowLatency = settings.lowLatency;
+			output.gopSize = getGopSize();
+			if (!outputs[i]->prepare(output, settings.frameRate, settings.audioEnabled, settings.sampleRate, settings.numChannels, settings.audioCodecId, settings.audioBitRate))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,253 @@
+/*
+ *  Recording.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "FrameQueue.h"
+#include "FrameConverter.h"
+#include "FrameHash.h"
+#include "SceneDetector.h"
+#include "QualityGovernor.h"
+#include "SampleFifo.h"
+#include "RecordingOutput.h"
+#include "ChunkedEncoder.h"
+#include "TwoPassEncoder.h"
+
+namespace itg
+{
+	// called from the encoder thread once a recording's file has been finished and closed,
+	// succeeded is false if the file couldn't be opened or the encoder couldn't be set up
+	typedef void (*RecordingFinishedCallback)(const std::string& filePath, bool succeeded, void* userData);
+
+	// everything a recording is set up with, copied into each one so changing the
+	// exporter's settings never touches a recording that is still being finished
+	struct RecordingSettings
+	{
+		RecordingSettings();
+
+		FrameFormat inFormat;
+		int outW, outH;
+		int bitRate;
+		int frameRate;
+		CodecID codecId;
+		std::string container;
+		// time between captured frames
+		float frameInterval;
+		// more outputs of the same take, each scaled down from the one before it
+		// if that's big enough or from the master if it isn't, so add them largest first
+		std::vector<OutputSettings> renditions;
+
+		bool audioEnabled;
+		int sampleRate;
+		int numChannels;
+		CodecID audioCodecId;
+		int audioBitRate;
+		// how much audio can be waiting for the encoder thread before samples get dropped
+		int audioFifoSeconds;
+
+		bool skipDuplicateFrames;
+		bool adaptiveQuality;
+		// encoder and muxer settings for live streams
+		bool lowLatency;
+		// frames are added as fast as they're made rather than in real time, so the encoder
+		// thread takes each one as soon as it's free rather than pacing itself to frameInterval
+		bool offline;
+		// force keyframes on cuts in the content and only every SCENE_GOP_SIZE frames otherwise
+		bool sceneDetection;
+		// offline, analyse the frames while recording and encode them again after stop(),
+		// at bitRate or to fit targetFileSize (bytes) if it's set
+		bool twoPass;
+		int64_t targetFileSize;
+		// offline, split the frames into chunks encoded in parallel, see ChunkedEncoder
+		bool chunkedEncoding;
+		// 0 for one per core
+		int chunkWorkers;
+		// 0 for the default
+		int chunkFrames;
+
+		RecordingFinishedCallback finished;
+		void* finishedUserData;
+	};
+
+	// one take, from opening the codec to closing the file.  Each has its own encoders,
+	// muxer and encoder thread, so one can be finishing in the background while the
+	// next is already recording
+	class Recording
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		Recording(Clock* clock, Logger* logger, ThreadFactory* threads);
+		// waits for the recording to be finished
+		~Recording();
+
+		// open the codecs and set up the muxers, everything but the files
+		bool prepare(const RecordingSettings& settings);
+		// open the file and start taking frames, prepare() first unless prepared in the background
+		bool start(const std::string& filePath);
+		// frames already added are still encoded, then the file is finished
+		void stop();
+#ifdef _THREAD_CAPTURE
+		// prepare() on the recording's own thread, start() then only has to flag the start
+		// and the file is opened on that thread too
+		void prepareInBackground(const RecordingSettings& settings);
+		// wait for a background prepare(), false if it failed
+		bool waitUntilPrepared();
+		// drop a prepared recording that was never started
+		void cancel();
+#endif
+		// not recording, finishing or prepared, can be reused
+		bool isIdle();
+		// block until idle
+		void join();
+
+		inline bool isRecording() const { return recording; }
+		inline const std::string& getFilePath() const { return filePath; }
+		inline const RecordingSettings& getSettings() const { return settings; }
+
+		// takes over the caller's reference, encoded on the encoder thread.  With chunked
+		// encoding it waits while the workers have as many frames as they can hold
+		void addFrame(Frame* frame);
+		// audio thread safe
+		void addAudioSamples(const float* samples, int numFrames);
+
+		inline int getNumFramesEncoded() const { return frameNum - numFramesSkipped - numFramesDropped; }
+		inline int getNumFramesSkipped() const { return numFramesSkipped; }
+		inline int getNumFramesDropped() const { return numFramesDropped; }
+		inline int getNumAudioSamplesDropped() const { return audioSamplesDropped; }
+		inline QualityGovernor::Level getQualityLevel() const { return (QualityGovernor::Level)qualityLevel; }
+		// when the master output is a stream
+		float getStreamLatency() const;
+		int getNumPacketsDropped() const;
+
+	private:
+		Clock* clock;
+		Logger* logger;
+		ThreadFactory* threads;
+
+		// only used as a queue, the frames belong to the exporter's pool
+		FrameQueue frameQueue;
+#ifdef _THREAD_CAPTURE
+		void run();
+		Thread* thread;
+		volatile bool threadRunning;
+		// a background prepared recording waits for start() rather than giving up
+		volatile bool keepAlive;
+		// set by the encoder thread once only the file needs opening
+		volatile bool prepared;
+		volatile bool prepareFailed;
+		// false if chunked encoding was asked for but can't be used with the other settings
+		bool canEncodeChunks();
+		ChunkedEncoder chunks;
+		volatile bool chunked;
+#endif
+		bool initEncoder();
+		bool openFiles();
+		std::string getOutputPath(int output) const;
+
+		// false if the frame was skipped or dropped rather than encoded
+		bool encodeFrame(Frame* frame);
+		void writeVideo(int64_t pts);
+		int getGopSize() const;
+		// keyframe and chapter marks of a frame, applied to the next frame written
+		void takeMarks(Frame* frame);
+		void writeChapters();
+		void convertDirtyRows(Frame* frame);
+		void skipFrame(Frame* frame, bool partial);
+		// time one frame through conversion and encoding for the governor, false if it wasn't encoded
+		bool processFrame(Frame* frame);
+		void applyQualityLevel(QualityGovernor::Level level);
+		void encodeAudio(bool flush);
+		void finishRecord(bool succeeded);
+		void startRecord();
+		void resetEncoderState();
+		void closeEncoder();
+
+		RecordingSettings settings;
+		std::string filePath;
+
+		volatile bool recording;
+		int frameNum;
+		float recordStartTime;
+		// capture time of the frame being encoded
+		float frameTime;
+		int64_t lastVideoPts;
+
+		volatile int numFramesSkipped;
+		uint64_t lastFrameHash;
+		SceneDetector sceneDetector;
+
+		struct Chapter
+		{
+			std::string title;
+			// in frames
+			int64_t start;
+		};
+		std::vector<Chapter> chapters;
+		std::vector<std::string> pendingChapters;
+		bool pendingKeyframe;
+		// pts of the last frame that was skipped and hasn't been followed by a new one
+		int64_t pendingSkipPts;
+
+		QualityGovernor governor;
+		volatile int qualityLevel;
+		// only every frameDecimation'th frame is encoded
+		int frameDecimation;
+		volatile int numFramesDropped;
+
+		// the master output's frame holds a whole converted frame that partial frames can be drawn on top of
+		bool outFrameValid;
+		bool partialFramesSeen;
+		std::vector<unsigned char> dirtyBands;
+
+		SampleFifo audioFifo;
+		// encoder thread side copy of the fifo contents
+		std::vector<float> audioBuffer;
+		volatile float audioStartTime;
+		volatile bool audioStarted;
+		volatile int audioSamplesDropped;
+
+		// the master's frames go through here instead of its own encoder
+		TwoPassEncoder twoPassEncoder;
+		bool twoPassActive;
+
+		// the master first, then the renditions
+		std::vector<RecordingOutput*> outputs;
+		FrameConverter converter;
+		// for scaling renditions, follows the quality level
+		int scaleFlags;
+	};
+}
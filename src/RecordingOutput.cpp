@@ -0,0 +1,226 @@
+/*
+ *  RecordingOutput.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "RecordingOutput.h"
+
+namespace itg
+{
+	OutputSettings::OutputSettings(int outW, int outH, int bitRate, CodecID codecId, const std::string& container, const std::string& fileSuffix) :
+		outW(outW), outH(outH), bitRate(bitRate), codecId(codecId), container(container), fileSuffix(fileSuffix), lowLatency(false), gopSize(0)
+	{
+	}
+
+	RecordingOutput::RecordingOutput(Clock* clock, Logger* logger, ThreadFactory* threads) :
+		logger(logger),
+		audioEnabled(false),
+		streaming(false),
+		muxer(logger),
+		segmenter(logger),
+		streamWriter(clock, logger, threads),
+		encoder(logger),
+		audioEncoder(logger),
+		scaleCtx(NULL),
+		pixels(NULL),
+		frame(NULL),
+		allocatedW(0), allocatedH(0)
+	{
+	}
+
+	RecordingOutput::~RecordingOutput()
+	{
+		close();
+		if (scaleCtx) sws_freeContext(scaleCtx);
+		clearMemory();
+	}
+
+	bool RecordingOutput::prepare(const OutputSettings& settings, int frameRate, bool audioEnabled, int sampleRate, int numChannels, CodecID audioCodecId, int audioBitRate)
+	{
+		this->settings = settings;
+		this->audioEnabled = audioEnabled;
+		if (!frame || allocatedW != settings.outW || allocatedH != settings.outH) allocateMemory();
+
+		if (!muxer.setup(settings.container, settings.codecId)) return false;
+
+		/////////////////////////////////////////////////////////////
+		// set up the video stream
+		AVStream* videoStream = muxer.addVideoStream();
+		if (!encoder.configure(videoStream, settings.codecId, settings.outW, settings.outH, settings.bitRate, frameRate, muxer.needsGlobalHeader(), settings.lowLatency)) return false;
+		if (settings.gopSize > 0) encoder.setGopSize(settings.gopSize);
+
+		if (audioEnabled)
+		{
+			AVStream* audioStream = muxer.addAudioStream(audioCodecId);
+			if (!audioEncoder.configure(audioStream, audioCodecId, sampleRate, numChannels, audioBitRate, muxer.needsGlobalHeader())) return false;
+		}
+
+		if (!muxer.setParameters()) return false;
+		// mpegts holds audio back for up to this long to fill its PES packets
+		if (settings.lowLatency) muxer.getFormatContext()->max_delay = AV_TIME_BASE / 10;
+		if (!encoder.open()) return false;
+		return !audioEnabled || audioEncoder.open();
+	}
+
+	bool RecordingOutput::open(const std::string& filePath)
+	{
+		this->filePath = filePath;
+		streaming = Muxer::isStreamUrl(filePath) || HlsSegmenter::isPlaylistPath(filePath);
+		if (HlsSegmenter::isPlaylistPath(filePath))
+		{
+			// the muxer set up in prepare() only holds the streams the segments copy
+			if (!segmenter.open(filePath, encoder.getStream(), audioEnabled ? audioEncoder.getStream() : NULL)) return false;
+			// segments go to disk, nothing worth dropping packets for
+			streamWriter.start(&segmenter, false);
+			return true;
+		}
+		if (!muxer.open(filePath)) return false;
+		if (streaming) streamWriter.start(&muxer);
+		return true;
+	}
+
+	void RecordingOutput::finish()
+	{
+		if (streaming) streamWriter.stop();
+		if (segmenter.isOpen()) segmenter.finish();
+		else muxer.finish();
+	}
+
+	void RecordingOutput::close()
+	{
+		if (streaming) streamWriter.stop();
+		segmenter.close();
+		encoder.close();
+		audioEncoder.close();
+		muxer.close();
+	}
+
+	void RecordingOutput::scaleFrom(RecordingOutput* source, int flags)
+	{
+		scaleCtx = sws_getCachedContext(scaleCtx, source->getWidth(), source->getHeight(), PIX_FMT_YUV420P,
+			settings.outW, settings.outH, PIX_FMT_YUV420P, flags, NULL, NULL, NULL);
+		AVFrame* in = source->getFrame();
+		sws_scale(scaleCtx, in->data, in->linesize, 0, source->getHeight(), frame->data, frame->linesize);
+	}
+
+	void RecordingOutput::encodeVideo(int64_t pts, float captureTime, bool keyframe)
+	{
+		// the encoder picks the type of every frame that isn't forced
+		frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+		int outSize = encoder.encode(frame);
+		if (outSize > 0)
+		{
+			AVPacket pkt;
+			av_init_packet(&pkt);
+			pkt.pts = av_rescale_q(pts, encoder.getCodecContext()->time_base, encoder.getStream()->time_base);
+			// only real keyframes, so forced ones are seek points in files and receivers joining
+			// a stream can find them.  Without a coded frame to go by every packet is marked, as before
+			AVFrame* coded = encoder.getCodecContext()->coded_frame;
+			if (!coded || coded->key_frame) pkt.flags |= AV_PKT_FLAG_KEY;
+			pkt.dts = pkt.pts;
+			pkt.stream_index = encoder.getStream()->index;
+			pkt.data = encoder.getEncodedData();
+			pkt.size = outSize;
+			writePacket(&pkt, true, captureTime);
+		}
+	}
+
+	void RecordingOutput::writeVideoPacket(AVPacket* pkt)
+	{
+		AVRational timeBase = encoder.getCodecContext()->time_base;
+		pkt->pts = av_rescale_q(pkt->pts, timeBase, encoder.getStream()->time_base);
+		pkt->dts = av_rescale_q(pkt->dts, timeBase, encoder.getStream()->time_base);
+		pkt->stream_index = encoder.getStream()->index;
+		writePacket(pkt, true, 0.f);
+	}
+
+	void RecordingOutput::addChapter(const std::string& title, int64_t start, int64_t end)
+	{
+		if (streaming) return;
+		muxer.addChapter(title, encoder.getCodecContext()->time_base, start, end);
+	}
+
+	void RecordingOutput::addAudioSamples(const float* samples, int numFrames)
+	{
+		if (audioEnabled) audioEncoder.addSamples(samples, numFrames);
+	}
+
+	void RecordingOutput::encodeAudio(bool flush, float offset)
+	{
+		if (!audioEnabled) return;
+
+		// audio that started after the video is offset rather than padded
+		AVCodecContext* audioCtx = audioEncoder.getCodecContext();
+		int64_t start = (int64_t)(offset * audioCtx->sample_rate);
+		if (start < 0) start = 0;
+
+		int outSize;
+		while ((outSize = audioEncoder.encode(flush)) >= 0)
+		{
+			if (outSize == 0) continue;
+			AVPacket pkt;
+			av_init_packet(&pkt);
+			pkt.pts = av_rescale_q(start + audioEncoder.getPts(), audioCtx->time_base, audioEncoder.getStream()->time_base);
+			pkt.dts = pkt.pts;
+			pkt.flags |= AV_PKT_FLAG_KEY;
+			pkt.stream_index = audioEncoder.getStream()->index;
+			pkt.data = audioEncoder.getEncodedData();
+			pkt.size = outSize;
+			writePacket(&pkt, false, 0.f);
+		}
+	}
+
+	void RecordingOutput::writePacket(AVPacket* pkt, bool video, float captureTime)
+	{
+		if (streaming) streamWriter.push(pkt, video, captureTime);
+		else muxer.writePacket(pkt);
+	}
+
+	void RecordingOutput::allocateMemory()
+	{
+		// clear if we need to reallocate
+		clearMemory();
+
+		int size = avpicture_get_size(PIX_FMT_YUV420P, settings.outW, settings.outH);
+		pixels = (unsigned char*)av_malloc(size);
+		frame = avcodec_alloc_frame();
+		avpicture_fill((AVPicture*)frame, pixels, PIX_FMT_YUV420P, settings.outW, settings.outH);
+		allocatedW = settings.outW;
+		allocatedH = settings.outH;
+	}
+
+	void RecordingOutput::clearMemory()
+	{
+		av_free(frame);
+		av_free(pixels);
+
+		frame = NULL;
+		pixels = NULL;
+	}
+}
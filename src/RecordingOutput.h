@@ -0,0 +1,129 @@
+/*
+ *  RecordingOutput.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <string>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "VideoEncoder.h"
+#include "AudioEncoder.h"
+#include "Muxer.h"
+#include "StreamWriter.h"
+#include "HlsSegmenter.h"
+
+namespace itg
+{
+	// size, codec and file of one output of a recording
+	struct OutputSettings
+	{
+		OutputSettings(int outW = 0, int outH = 0, int bitRate = 0, CodecID codecId = CODEC_ID_MPEG4, const std::string& container = "mp4", const std::string& fileSuffix = "");
+
+		int outW, outH;
+		int bitRate;
+		CodecID codecId;
+		std::string container;
+		// renditions are written next to the master, with this added to its name
+		std::string fileSuffix;
+		// encoder and muxer settings for live streams, see VideoEncoder::configure()
+		bool lowLatency;
+		// 0 for VideoEncoder::GOP_SIZE
+		int gopSize;
+	};
+
+	// one file or stream written by a recording: its own YUV frame, encoders and muxer.  A
+	// recording's master output is converted into from the captured frames, the other
+	// renditions scale down from a larger output's YUV rather than going back to the source.
+	// Streams and HLS segments are muxed and written by a StreamWriter so the network and
+	// segment rotation never hold up the encoder
+	class RecordingOutput
+	{
+	public:
+		RecordingOutput(Clock* clock, Logger* logger, ThreadFactory* threads);
+		~RecordingOutput();
+
+		// open the codecs and set up the muxer, everything but the file
+		bool prepare(const OutputSettings& settings, int frameRate, bool audioEnabled, int sampleRate, int numChannels, CodecID audioCodecId, int audioBitRate);
+		// a file, a stream URL or an HLS playlist (.m3u8)
+		bool open(const std::string& filePath);
+		// send what's queued for a stream and write the trailer
+		void finish();
+		// close the file and free the codecs, the YUV frame is kept for the next take
+		void close();
+
+		// scale another output's frame into this one's, YUV420P to YUV420P
+		void scaleFrom(RecordingOutput* source, int flags);
+		// encode whatever is in the frame as pts, in frames, captured at captureTime on the exporter's
+		// clock, as an intra frame if keyframe is set
+		void encodeVideo(int64_t pts, float captureTime, bool keyframe = false);
+		// write a packet encoded elsewhere with the same settings, pts and dts in frames
+		void writeVideoPacket(AVPacket* pkt);
+		// start and end in frames, before finish().  Files only
+		void addChapter(const std::string& title, int64_t start, int64_t end);
+
+		void addAudioSamples(const float* samples, int numFrames);
+		// offset is when the audio started relative to the video, in seconds
+		void encodeAudio(bool flush, float offset);
+
+		inline AVFrame* getFrame() { return frame; }
+		inline int getWidth() const { return settings.outW; }
+		inline int getHeight() const { return settings.outH; }
+		inline bool isOpen() const { return muxer.isOpen() || segmenter.isOpen(); }
+		inline const std::string& getFilePath() const { return filePath; }
+		inline VideoEncoder& getEncoder() { return encoder; }
+
+		inline bool isStreaming() const { return streaming; }
+		inline float getStreamLatency() const { return streamWriter.getLatency(); }
+		inline int getNumPacketsDropped() const { return streamWriter.getNumPacketsDropped(); }
+
+	private:
+		void allocateMemory();
+		void clearMemory();
+		void writePacket(AVPacket* pkt, bool video, float captureTime);
+
+		Logger* logger;
+		OutputSettings settings;
+		std::string filePath;
+		bool audioEnabled;
+		bool streaming;
+
+		Muxer muxer;
+		HlsSegmenter segmenter;
+		StreamWriter streamWriter;
+		VideoEncoder encoder;
+		AudioEncoder audioEncoder;
+		SwsContext* scaleCtx;
+
+		unsigned char* pixels;
+		AVFrame* frame;
+		int allocatedW, allocatedH;
+	};
+}
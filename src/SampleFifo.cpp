@@ -0,0 +1,110 @@
+/*
+ *  SampleFifo.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "SampleFifo.h"
+#include "ExporterPlatform.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace itg
+{
+	SampleFifo::SampleFifo() :
+		buffer(NULL), capacity(0), mask(0), writePos(0), readPos(0)
+	{
+	}
+
+	SampleFifo::~SampleFifo()
+	{
+		delete[] buffer;
+	}
+
+	void SampleFifo::allocate(int capacity)
+	{
+		unsigned size = 1;
+		while (size < (unsigned)capacity) size <<= 1;
+		delete[] buffer;
+		buffer = new float[size];
+		this->capacity = size;
+		mask = size - 1;
+		reset();
+	}
+
+	void SampleFifo::reset()
+	{
+		writePos = 0;
+		readPos = 0;
+		memoryBarrier();
+	}
+
+	int SampleFifo::write(const float* samples, int count)
+	{
+		unsigned free = capacity - (writePos - readPos);
+		if ((unsigned)count > free) count = free;
+
+		unsigned start = writePos & mask;
+		unsigned first = capacity - start < (unsigned)count ? capacity - start : count;
+		memcpy(buffer + start, samples, first * sizeof(float));
+		memcpy(buffer, samples + first, (count - first) * sizeof(float));
+
+		// samples have to land before the reader can see them
+		memoryBarrier();
+		writePos += count;
+		return count;
+	}
+
+	int SampleFifo::read(float* samples, int count)
+	{
+		unsigned ready = writePos - readPos;
+		memoryBarrier();
+		if ((unsigned)count > ready) count = ready;
+
+		unsigned start = readPos & mask;
+		unsigned first = capacity - start < (unsigned)count ? capacity - start : count;
+		memcpy(samples, buffer + start, first * sizeof(float));
+		memcpy(samples + first, buffer, (count - first) * sizeof(float));
+
+		// don't hand the space back until we're done copying out of it
+		memoryBarrier();
+		readPos += count;
+		return count;
+	}
+
+	int SampleFifo::getFree() const
+	{
+		return capacity - (writePos - readPos);
+	}
+
+	int SampleFifo::available() const
+	{
+		return writePos - readPos;
+	}
+}
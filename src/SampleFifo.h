@@ -0,0 +1,68 @@
+/*
+ *  SampleFifo.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+namespace itg
+{
+	// single producer, single consumer ring buffer of audio samples, the producer side
+	// never locks or allocates so it's safe to call from a sound card callback
+	class SampleFifo
+	{
+	public:
+		SampleFifo();
+		~SampleFifo();
+
+		// capacity is rounded up to a power of two, not thread safe
+		void allocate(int capacity);
+		// only when neither side is using it
+		void reset();
+
+		// producer, returns how many samples fitted, the rest are dropped
+		int write(const float* samples, int count);
+		// consumer, returns how many samples were read
+		int read(float* samples, int count);
+		// consumer, number of samples ready to read
+		int available() const;
+		// producer, number of samples that can be written
+		int getFree() const;
+
+		inline int getCapacity() const { return capacity; }
+
+	private:
+		float* buffer;
+		unsigned capacity;
+		unsigned mask;
+		// free running counters, only the owning side writes each one
+		volatile unsigned writePos;
+		volatile unsigned readPos;
+	};
+}
@@ -0,0 +1,109 @@
+/*
+ *  SceneDetector.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "SceneDetector.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace itg
+{
+	// share of the samples that moved to another histogram bin
+	static const float HISTOGRAM_THRESHOLD = .3f;
+	// mean absolute luma difference
+	static const int SAD_THRESHOLD = 20;
+
+	static const int SAD_BLOCK = 64;
+
+	// fixed size blocks so the compiler turns them into packed SADs even at -O2
+	static uint32_t rowSad(const unsigned char* a, const unsigned char* b, int count)
+	{
+		uint32_t sad = 0;
+		int i = 0;
+		for (; i + SAD_BLOCK <= count; i += SAD_BLOCK)
+		{
+			uint32_t blockSad = 0;
+			for (int j = 0; j < SAD_BLOCK; j++) blockSad += abs(a[i + j] - b[i + j]);
+			sad += blockSad;
+		}
+		for (; i < count; i++) sad += abs(a[i] - b[i]);
+		return sad;
+	}
+
+	SceneDetector::SceneDetector()
+	{
+		reset();
+	}
+
+	void SceneDetector::reset()
+	{
+		hasLast = false;
+		framesSinceCut = 0;
+		memset(lastHistogram, 0, sizeof(lastHistogram));
+	}
+
+	bool SceneDetector::isCut(const unsigned char* luma, int linesize, int width, int height)
+	{
+		int numRows = (height + ROW_STEP - 1) / ROW_STEP;
+		if ((int)lastRows.size() != numRows * width)
+		{
+			lastRows.resize(numRows * width);
+			hasLast = false;
+		}
+
+		memset(histogram, 0, sizeof(histogram));
+		uint32_t sad = 0;
+		for (int i = 0; i < numRows; i++)
+		{
+			const unsigned char* row = luma + i * ROW_STEP * linesize;
+			unsigned char* last = &lastRows[i * width];
+			if (hasLast) sad += rowSad(row, last, width);
+			// the histogram can't be vectorised, a quarter of the columns is plenty for it
+			for (int x = 0; x < width; x += COLUMN_STEP) histogram[row[x] * HISTOGRAM_BINS / 256]++;
+			memcpy(last, row, width);
+		}
+
+		bool cut = false;
+		framesSinceCut++;
+		if (hasLast && framesSinceCut >= MIN_SCENE_FRAMES)
+		{
+			uint32_t moved = 0;
+			for (int i = 0; i < HISTOGRAM_BINS; i++) moved += histogram[i] > lastHistogram[i] ? histogram[i] - lastHistogram[i] : 0;
+			int numSamples = numRows * width;
+			int numBinned = numRows * ((width + COLUMN_STEP - 1) / COLUMN_STEP);
+			cut = moved > HISTOGRAM_THRESHOLD * numBinned && sad > (uint32_t)SAD_THRESHOLD * numSamples;
+			if (cut) framesSinceCut = 0;
+		}
+		memcpy(lastHistogram, histogram, sizeof(histogram));
+		hasLast = true;
+		return cut;
+	}
+}
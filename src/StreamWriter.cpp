@@ -0,0 +1,179 @@
+/*
+ *  StreamWriter.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "StreamWriter.h"
+
+namespace itg
+{
+	const float StreamWriter::MAX_QUEUE_DELAY = .5f;
+
+	StreamWriter::StreamWriter(Clock* clock, Logger* logger, ThreadFactory* threads) :
+#ifdef _THREAD_CAPTURE
+		thread(NULL),
+		running(false),
+#endif
+		clock(clock),
+		logger(logger),
+		threads(threads),
+		sink(NULL),
+		dropWhenCongested(true),
+		waitForKeyFrame(false),
+		latency(0.f),
+		numPacketsDropped(0)
+	{
+		mutex = threads->createMutex();
+#ifdef _THREAD_CAPTURE
+		thread = threads->createThread();
+#endif
+	}
+
+	StreamWriter::~StreamWriter()
+	{
+		stop();
+#ifdef _THREAD_CAPTURE
+		delete thread;
+#endif
+		delete mutex;
+	}
+
+	void StreamWriter::start(PacketSink* sink, bool dropWhenCongested)
+	{
+		stop();
+		this->sink = sink;
+		this->dropWhenCongested = dropWhenCongested;
+		waitForKeyFrame = false;
+		latency = 0.f;
+		numPacketsDropped = 0;
+#ifdef _THREAD_CAPTURE
+		running = true;
+		thread->start(this);
+#endif
+	}
+
+	void StreamWriter::stop()
+	{
+#ifdef _THREAD_CAPTURE
+		running = false;
+		thread->join();
+#endif
+		// anything pushed after the thread saw it was stopping
+		while (!queue.empty())
+		{
+			send(queue.front());
+			queue.pop_front();
+		}
+		sink = NULL;
+	}
+
+	void StreamWriter::push(AVPacket* pkt, bool video, float captureTime)
+	{
+		QueuedPacket packet;
+		packet.pkt = *pkt;
+		packet.video = video;
+		packet.captureTime = captureTime;
+		packet.queuedTime = clock->getElapsedTimef();
+		// the packet points at the encoder's buffer, which is reused for the next one
+		av_dup_packet(&packet.pkt);
+
+#ifdef _THREAD_CAPTURE
+		ScopedLock lock(mutex);
+		bool congested = dropWhenCongested && !queue.empty() && packet.queuedTime - queue.front().queuedTime > MAX_QUEUE_DELAY;
+		if (video)
+		{
+			if (congested || (waitForKeyFrame && !(pkt->flags & AV_PKT_FLAG_KEY)))
+			{
+				waitForKeyFrame = true;
+				drop(packet);
+				return;
+			}
+			waitForKeyFrame = false;
+		}
+		else if (congested)
+		{
+			drop(packet);
+			return;
+		}
+		queue.push_back(packet);
+#else
+		send(packet);
+#endif
+	}
+
+// PRIVATE
+
+#ifdef _THREAD_CAPTURE
+	void StreamWriter::run()
+	{
+		while (true)
+		{
+			// running is cleared after the last packet is queued so read it before popping
+			bool stopping = !running;
+			memoryBarrier();
+
+			QueuedPacket packet;
+			bool popped = false;
+			{
+				ScopedLock lock(mutex);
+				if (!queue.empty())
+				{
+					packet = queue.front();
+					queue.pop_front();
+					popped = true;
+				}
+			}
+
+			if (popped) send(packet);
+			else if (stopping) break;
+			else threads->sleepMillis(1);
+		}
+	}
+#endif
+
+	void StreamWriter::send(QueuedPacket& packet)
+	{
+		// may block on the network, it's only the writer thread that waits
+		sink->writePacket(&packet.pkt);
+		sink->flush();
+		av_free_packet(&packet.pkt);
+
+		if (packet.video)
+		{
+			float sample = clock->getElapsedTimef() - packet.captureTime;
+			latency = latency == 0.f ? sample : .9f * latency + .1f * sample;
+		}
+	}
+
+	void StreamWriter::drop(QueuedPacket& packet)
+	{
+		av_free_packet(&packet.pkt);
+		if (!numPacketsDropped++) logger->log(EXPORTER_LOG_WARNING, "ofxMovieExporter: Stream can't keep up, dropping packets");
+	}
+}
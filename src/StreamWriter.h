@@ -0,0 +1,99 @@
+/*
+ *  StreamWriter.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "Muxer.h"
+
+namespace itg
+{
+	// packets on their way from the encoder thread to a network stream or segmenter.  The
+	// sink writes them on a thread of its own, so a slow or congested link drops packets
+	// instead of stalling the encoder.  Once a video packet is dropped the rest are dropped
+	// up to the next keyframe, so the receiver never gets frames that refer to missing ones
+	class StreamWriter
+#ifdef _THREAD_CAPTURE
+		: public Runnable
+#endif
+	{
+	public:
+		// packets that would wait longer than this to go out are dropped
+		static const float MAX_QUEUE_DELAY;
+
+		StreamWriter(Clock* clock, Logger* logger, ThreadFactory* threads);
+		~StreamWriter();
+
+		// sink must be open, with dropWhenCongested false packets wait however long it takes
+		void start(PacketSink* sink, bool dropWhenCongested = true);
+		// sends what's still queued then returns, call before the trailer is written
+		void stop();
+
+		// copies the packet, video packets carry the capture time of their frame
+		void push(AVPacket* pkt, bool video, float captureTime);
+
+		// average seconds from a frame being captured to its packet being sent
+		inline float getLatency() const { return latency; }
+		inline int getNumPacketsDropped() const { return numPacketsDropped; }
+
+	private:
+		struct QueuedPacket
+		{
+			AVPacket pkt;
+			bool video;
+			float captureTime;
+			float queuedTime;
+		};
+
+		void send(QueuedPacket& packet);
+		void drop(QueuedPacket& packet);
+#ifdef _THREAD_CAPTURE
+		void run();
+		Thread* thread;
+		volatile bool running;
+#endif
+
+		Clock* clock;
+		Logger* logger;
+		ThreadFactory* threads;
+		Mutex* mutex;
+		std::deque<QueuedPacket> queue;
+		PacketSink* sink;
+		bool dropWhenCongested;
+		// a video packet was dropped, drop the rest until a keyframe
+		bool waitForKeyFrame;
+
+		volatile float latency;
+		volatile int numPacketsDropped;
+	};
+}
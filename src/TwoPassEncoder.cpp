@@ -0,0 +1,205 @@
+/*
+ *  TwoPassEncoder.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "TwoPassEncoder.h"
+
+namespace itg
+{
+	const float TwoPassEncoder::CONTAINER_OVERHEAD = .01f;
+
+	TwoPassEncoder::TwoPassEncoder(Logger* logger) :
+		logger(logger), frameRate(25), muxer(logger), encoder(logger), journal(NULL), pixels(NULL), picture(NULL)
+	{
+		picture = avcodec_alloc_frame();
+	}
+
+	TwoPassEncoder::~TwoPassEncoder()
+	{
+		cancel();
+		av_free(picture);
+		av_free(pixels);
+	}
+
+	bool TwoPassEncoder::start(const OutputSettings& settings, int frameRate, const std::string& filePath)
+	{
+		cancel();
+		this->settings = settings;
+		this->frameRate = frameRate;
+		stats.clear();
+		framePts.clear();
+		journalBuf.resize(avpicture_get_size(PIX_FMT_YUV420P, settings.outW, settings.outH));
+
+		journalPath = filePath + ".2pass";
+		journal = fopen(journalPath.c_str(), "wb");
+		if (!journal)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open %s", journalPath.c_str());
+			return false;
+		}
+		if (!openEncoder(1, settings.bitRate))
+		{
+			cancel();
+			return false;
+		}
+		// the stats only need the frame types and rough costs, not the best motion vectors
+		encoder.setFastMotionSearch(true);
+		return true;
+	}
+
+	void TwoPassEncoder::addFrame(AVFrame* frame, int64_t pts, bool keyframe)
+	{
+		if (!journal) return;
+		frame->pts = pts;
+		frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+		collectStats(encoder.encode(frame));
+
+		avpicture_layout((AVPicture*)frame, PIX_FMT_YUV420P, settings.outW, settings.outH, &journalBuf[0], journalBuf.size());
+		if (fwrite(&journalBuf[0], 1, journalBuf.size(), journal) != journalBuf.size())
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not write to %s", journalPath.c_str());
+			return;
+		}
+		framePts.push_back(pts);
+	}
+
+	bool TwoPassEncoder::finish(RecordingOutput* output, int64_t targetFileSize, int otherBitRate)
+	{
+		if (!journal) return false;
+
+		// the analysis pass's stats for the frames it held back
+		int size;
+		while ((size = encoder.encode(NULL)) > 0) collectStats(size);
+		closeEncoder();
+		fclose(journal);
+		journal = NULL;
+		if (framePts.empty())
+		{
+			cancel();
+			return true;
+		}
+
+		int bitRate = settings.bitRate;
+		if (targetFileSize > 0)
+		{
+			double seconds = (double)(framePts.back() + 1) / frameRate;
+			double bits = targetFileSize * 8. * (1. - CONTAINER_OVERHEAD) - otherBitRate * seconds;
+			bitRate = (int)(bits / seconds);
+			if (bitRate <= 0)
+			{
+				logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: %lld bytes isn't enough for %.1f seconds of video", (long long)targetFileSize, seconds);
+				cancel();
+				return false;
+			}
+		}
+
+		FILE* file = fopen(journalPath.c_str(), "rb");
+		if (!file || !openEncoder(2, bitRate))
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not start the second pass of %s", output->getFilePath().c_str());
+			if (file) fclose(file);
+			cancel();
+			return false;
+		}
+		if (!pixels) pixels = (unsigned char*)av_malloc(journalBuf.size());
+		avpicture_fill((AVPicture*)picture, pixels, PIX_FMT_YUV420P, settings.outW, settings.outH);
+
+		bool succeeded = true;
+		for (unsigned i = 0; i < framePts.size(); i++)
+		{
+			if (fread(pixels, 1, journalBuf.size(), file) != journalBuf.size())
+			{
+				logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not read frame %d back from %s", i, journalPath.c_str());
+				succeeded = false;
+				break;
+			}
+			picture->pts = framePts[i];
+			writePacket(output, encoder.encode(picture), framePts[i]);
+		}
+		while ((size = encoder.encode(NULL)) > 0) writePacket(output, size, framePts.back());
+		fclose(file);
+		cancel();
+		return succeeded;
+	}
+
+	void TwoPassEncoder::cancel()
+	{
+		closeEncoder();
+		if (journal) fclose(journal);
+		journal = NULL;
+		if (!journalPath.empty()) remove(journalPath.c_str());
+		journalPath.clear();
+		stats.clear();
+	}
+
+// PRIVATE
+
+	// an encoder set up like the output's, apart from the rate control
+	bool TwoPassEncoder::openEncoder(int pass, int bitRate)
+	{
+		closeEncoder();
+		if (!muxer.setup(settings.container, settings.codecId)) return false;
+		AVStream* stream = muxer.addVideoStream();
+		if (!encoder.configure(stream, settings.codecId, settings.outW, settings.outH, bitRate, frameRate, muxer.needsGlobalHeader())) return false;
+		// both passes need the same GOPs
+		if (settings.gopSize > 0) encoder.setGopSize(settings.gopSize);
+		if (!muxer.setParameters()) return false;
+		statsIn.assign(stats.begin(), stats.end());
+		statsIn.push_back(0);
+		encoder.setPass(pass, &statsIn[0]);
+		return encoder.open();
+	}
+
+	void TwoPassEncoder::closeEncoder()
+	{
+		encoder.close();
+		muxer.close();
+	}
+
+	void TwoPassEncoder::collectStats(int size)
+	{
+		// the stats are for the frame that just came out
+		if (size > 0) stats += encoder.getStats();
+	}
+
+	void TwoPassEncoder::writePacket(RecordingOutput* output, int size, int64_t fallbackPts)
+	{
+		if (size <= 0) return;
+		AVFrame* coded = encoder.getCodecContext()->coded_frame;
+		AVPacket pkt;
+		av_init_packet(&pkt);
+		pkt.pts = coded && coded->pts != (int64_t)AV_NOPTS_VALUE ? coded->pts : fallbackPts;
+		pkt.dts = pkt.pts;
+		if (coded && coded->key_frame) pkt.flags |= AV_PKT_FLAG_KEY;
+		pkt.data = encoder.getEncodedData();
+		pkt.size = size;
+		output->writeVideoPacket(&pkt);
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ *  TwoPassEncoder.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+#include "VideoEncoder.h"
+#include "Muxer.h"
+#include "RecordingOutput.h"
+
+namespace itg
+{
+	// two pass rate control for a recording's master output.  While recording, each converted
+	// frame goes through a quick analysis pass (the same encoder with fast motion search)
+	// and is journalled to disk as YUV.  After stop() the journal is encoded again at full
+	// quality, with the first pass's stats telling libav's rate control where to spend the
+	// bits, so the file comes out at the average bit rate or size asked for
+	class TwoPassEncoder
+	{
+	public:
+		// part of a target file size left for the container
+		static const float CONTAINER_OVERHEAD;
+
+		TwoPassEncoder(Logger* logger);
+		~TwoPassEncoder();
+
+		// opens the analysis encoder and <filePath>.2pass next to the file
+		bool start(const OutputSettings& settings, int frameRate, const std::string& filePath);
+		// analyse one frame of the master output and journal it, pts in frames.  Forced
+		// keyframes end up in the stats, so the second pass places them the same way
+		void addFrame(AVFrame* frame, int64_t pts, bool keyframe = false);
+		// encode the journal again into output, which must be set up like settings, at the
+		// settings' bit rate or, if targetFileSize (bytes) is set, whatever fits in it with
+		// otherBitRate (the audio) alongside
+		bool finish(RecordingOutput* output, int64_t targetFileSize, int otherBitRate);
+		// closes everything and deletes the journal
+		void cancel();
+
+		inline bool isRunning() const { return journal != NULL; }
+
+	private:
+		bool openEncoder(int pass, int bitRate);
+		void closeEncoder();
+		void collectStats(int size);
+		void writePacket(RecordingOutput* output, int size, int64_t fallbackPts);
+
+		Logger* logger;
+		OutputSettings settings;
+		int frameRate;
+		// only holds the stream the encoders' contexts belong to, never opened
+		Muxer muxer;
+		VideoEncoder encoder;
+		// one line per frame from the first pass, what the second is set up with
+		std::string stats;
+		// libav's rate control cuts up the copy it's given
+		std::vector<char> statsIn;
+
+		std::string journalPath;
+		FILE* journal;
+		std::vector<unsigned char> journalBuf;
+		// of each journalled frame
+		std::vector<int64_t> framePts;
+		// second pass frames, read back from the journal
+		unsigned char* pixels;
+		AVFrame* picture;
+	};
+}
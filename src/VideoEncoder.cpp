@@ -0,0 +1,135 @@
+/*
+ *  VideoEncoder.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "VideoEncoder.h"
+
+namespace itg
+{
+	VideoEncoder::VideoEncoder(Logger* logger) :
+		logger(logger), stream(NULL), codec(NULL), codecCtx(NULL), encodedBuf(NULL), opened(false), defaultSubpelQuality(8)
+	{
+		encodedBuf = (unsigned char*)av_malloc(ENCODED_FRAME_BUFFER_SIZE);
+	}
+
+	VideoEncoder::~VideoEncoder()
+	{
+		close();
+		av_free(encodedBuf);
+	}
+
+	bool VideoEncoder::configure(AVStream* stream, CodecID codecId, int outW, int outH, int bitRate, int frameRate, bool globalHeader, bool lowLatency)
+	{
+		/////////////////////////////////////////////////////////////
+		// find codec
+		codec = avcodec_find_encoder(codecId);
+		if (!codec)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Codec not found");
+			return false;
+		}
+
+		/////////////////////////////////////////////////////////////
+		// init codec context
+		this->stream = stream;
+		codecCtx = stream->codec;
+		codecCtx->bit_rate = bitRate;
+		codecCtx->width = outW;
+		codecCtx->height = outH;
+
+		codecCtx->time_base.num = 1;//codecCtx->ticks_per_frame;
+		codecCtx->time_base.den = frameRate;
+		stream->time_base = codecCtx->time_base;
+
+		codecCtx->gop_size = GOP_SIZE; /* emit one intra frame every ten frames */
+		codecCtx->pix_fmt = PIX_FMT_YUV420P;
+
+		if (codecCtx->codec_id == CODEC_ID_MPEG1VIDEO)
+		{
+			/* needed to avoid using macroblocks in which some coeffs overflow
+			 this doesnt happen with normal video, it just happens here as the
+			 motion of the chroma plane doesnt match the luma plane */
+			codecCtx->mb_decision=2;
+		}
+		if (lowLatency)
+		{
+			codecCtx->max_b_frames = 0;
+			codecCtx->rc_max_rate = bitRate;
+			codecCtx->rc_buffer_size = bitRate / frameRate;
+			codecCtx->rtp_payload_size = LOW_LATENCY_SLICE_SIZE;
+			codecCtx->thread_type = FF_THREAD_SLICE;
+		}
+		if (globalHeader) codecCtx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+		return true;
+	}
+
+	void VideoEncoder::setPass(int pass, char* stats)
+	{
+		if (pass == 1) codecCtx->flags |= CODEC_FLAG_PASS1;
+		else if (pass == 2)
+		{
+			codecCtx->flags |= CODEC_FLAG_PASS2;
+			codecCtx->stats_in = stats;
+		}
+	}
+
+	bool VideoEncoder::open()
+	{
+		// open codec
+		if (avcodec_open(codecCtx, codec) < 0)
+		{
+			logger->log(EXPORTER_LOG_ERROR, "ofxMovieExporter: Could not open codec");
+			return false;
+		}
+		opened = true;
+		defaultSubpelQuality = codecCtx->me_subpel_quality;
+		return true;
+	}
+
+	void VideoEncoder::close()
+	{
+		// the context itself belongs to the stream and is freed by the muxer
+		if (opened) avcodec_close(codecCtx);
+		opened = false;
+		codecCtx = NULL;
+		stream = NULL;
+	}
+
+	void VideoEncoder::setFastMotionSearch(bool fast)
+	{
+		if (!opened) return;
+		codecCtx->me_subpel_quality = fast ? 1 : defaultSubpelQuality;
+	}
+
+	int VideoEncoder::encode(AVFrame* frame)
+	{
+		return avcodec_encode_video(codecCtx, encodedBuf, ENCODED_FRAME_BUFFER_SIZE, frame);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ *  VideoEncoder.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include "LibAv.h"
+#include "ExporterPlatform.h"
+
+namespace itg
+{
+	// the codec side of a recording, encodes YUV frames into a stream owned by a Muxer
+	class VideoEncoder
+	{
+	public:
+		static const int ENCODED_FRAME_BUFFER_SIZE = 500000;
+		// bytes per slice in low latency mode, fits a UDP datagram
+		static const int LOW_LATENCY_SLICE_SIZE = 1200;
+		// frames from one intra frame to the next
+		static const int GOP_SIZE = 10;
+		// when keyframes are also forced on scene cuts, ten seconds at 25fps
+		static const int SCENE_GOP_SIZE = 250;
+
+		VideoEncoder(Logger* logger);
+		~VideoEncoder();
+
+		// find the codec and set up the stream's codec context.  lowLatency turns off
+		// B-frames so every frame comes straight out, limits the rate control buffer to
+		// one frame and splits frames into datagram sized slices, for live streams
+		bool configure(AVStream* stream, CodecID codecId, int outW, int outH, int bitRate, int frameRate, bool globalHeader, bool lowLatency = false);
+		// two pass rate control, between configure() and open().  Pass 1 writes a line of
+		// stats per frame (getStats() after each one that comes out), pass 2 is given all
+		// of them and spends the bit rate where they say it's needed
+		void setPass(int pass, char* stats);
+		// longest run of frames without a keyframe, between configure() and open()
+		inline void setGopSize(int gopSize) { codecCtx->gop_size = gopSize; }
+		inline const char* getStats() const { return codecCtx && codecCtx->stats_out ? codecCtx->stats_out : ""; }
+		// open the codec, call once the muxer has had its parameters set
+		bool open();
+		void close();
+
+		// trade motion estimation quality for speed, takes effect from the next frame for
+		// libav's own encoders, codecs that fix their settings when opened (x264) ignore it
+		void setFastMotionSearch(bool fast);
+
+		// returns the number of bytes written to getEncodedData(), 0 if the codec buffered the frame
+		int encode(AVFrame* frame);
+		inline unsigned char* getEncodedData() { return encodedBuf; }
+
+		inline AVCodecContext* getCodecContext() { return codecCtx; }
+		inline AVStream* getStream() { return stream; }
+
+	private:
+		Logger* logger;
+		AVStream* stream;
+		AVCodec* codec;
+		AVCodecContext* codecCtx;
+		unsigned char* encodedBuf;
+		bool opened;
+		int defaultSubpelQuality;
+	};
+}
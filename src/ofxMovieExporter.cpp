@@ -30,29 +30,85 @@
  *
  */
 #include "ofxMovieExporter.h"
-#include "ofThread.h"
 
 namespace itg
 {
-	const string ofxMovieExporter::FILENAME_PREFIX = "capture";
-	const string ofxMovieExporter::CONTAINER = "mp4";
+	// openFrameworks implementations of what the encoder core needs from the outside world
+	class OfClock : public Clock
+	{
+	public:
+		float getElapsedTimef() { return ofGetElapsedTimef(); }
+	};
 
-	ofxMovieExporter::ofxMovieExporter() {
-		outputFormat = NULL;
-		formatCtx = NULL;
-		videoStream = NULL;
-		
-		codec = NULL;
-		codecCtx = NULL;
-		convertCtx = NULL;
-		
-		inPixels = NULL;
-		outPixels = NULL;
-		encodedBuf = NULL;
+	class OfLogger : public Logger
+	{
+	protected:
+		void write(ExporterLogLevel level, const string& message)
+		{
+			switch (level)
+			{
+				case EXPORTER_LOG_VERBOSE: ofLog(OF_LOG_VERBOSE, message); break;
+				case EXPORTER_LOG_NOTICE: ofLog(OF_LOG_NOTICE, message); break;
+				case EXPORTER_LOG_WARNING: ofLog(OF_LOG_WARNING, message); break;
+				default: ofLog(OF_LOG_ERROR, message); break;
+			}
+		}
+	};
+
+	class OfMutex : public Mutex
+	{
+	public:
+		void lock() { mutex.lock(); }
+		void unlock() { mutex.unlock(); }
+
+	private:
+		ofMutex mutex;
+	};
 
-		inFrame = NULL;
-		outFrame = NULL;
+	class OfThread : public Thread, public ofThread
+	{
+	public:
+		OfThread() : runnable(NULL) {}
+		~OfThread() { join(); }
+
+		void start(Runnable* runnable)
+		{
+			join();
+			this->runnable = runnable;
+			startThread(true, false);
+		}
 
+		void join() { waitForThread(false); }
+
+	private:
+		void threadedFunction()
+		{
+			runnable->run();
+			stopThread();
+		}
+
+		Runnable* runnable;
+	};
+
+	class OfThreadFactory : public ThreadFactory
+	{
+	public:
+		Mutex* createMutex() { return new OfMutex(); }
+		Thread* createThread() { return new OfThread(); }
+		void sleepMillis(int millis) { ofSleepMillis(millis); }
+	};
+
+	static OfClock defaultClock;
+	static OfLogger defaultLogger;
+	static OfThreadFactory defaultThreadFactory;
+
+	const string ofxMovieExporter::FILENAME_PREFIX = "capture";
+	const string ofxMovieExporter::CONTAINER = "mp4";
+
+	ofxMovieExporter::ofxMovieExporter() :
+		exporter(&defaultClock, &defaultLogger, &defaultThreadFactory),
+		movieReader(&defaultLogger, &defaultThreadFactory)
+	{
 		posX = 0;
 		posY = 0;
 		inW = ofGetWidth();
@@ -60,8 +116,22 @@ namespace itg
 		outW = ofGetWidth();
 		outH = ofGetHeight();
 		
-		bool usePixelSource = false;
-		pixelSource = NULL;
+		frameRate = FRAME_RATE;
+		bitRate = BIT_RATE;
+		codecId = CODEC_ID;
+		container = CONTAINER;
+		numCaptures = 0;
+
+		readbackFormat = READBACK_AUTO;
+		activeReadbackFormat = READBACK_RGB;
+		gpuScaling = false;
+		gpuScalingActive = false;
+
+		damageTracking = false;
+		needsFullFrame = true;
+
+		sourceType = SOURCE_SCREEN;
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) pixelSource[i] = NULL;
 	}
 
 	void ofxMovieExporter::setup(
@@ -72,8 +142,6 @@ namespace itg
 		CodecID codecId,
 		string container)
 	{
-		if (outW % 2 == 1 || outH % 2 == 1) ofLog(OF_LOG_ERROR, "ofxMovieExporter: Resolution must be a multiple of 2");
-
 		this->outW = outW;
 		this->outH = outH;
 		this->frameRate = frameRate;
@@ -81,66 +149,81 @@ namespace itg
 		this->codecId = codecId;
 		this->container = container;
 
-		frameInterval = 1.f / (float)frameRate;
-
-		// HACK HACK HACK
-		// Time not syncing
-		// probably related to codec ticks_per_frame
-		frameInterval /= 3.f;
-		recording = false;
-		numCaptures = 0;
+		gpuScalingActive = false;
+		if (sourceType == SOURCE_SCREEN)
+		{
+			int screenY = ofGetViewportHeight() - posY - inH;
+			activeReadbackFormat = readbackFormat == READBACK_AUTO ? chooseReadbackFormat(posX, screenY, inW, inH) : readbackFormat;
 
-		// do one time encoder set up
-		av_register_all();
-		convertCtx = sws_getContext(inW, inH, PIX_FMT_RGB24, outW, outH, PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
+			if (gpuScaling && (outW < inW || outH < inH))
+			{
+				if (isBlitSupported())
+				{
+					scaleFbo.allocate(outW, outH, GL_RGBA);
+					gpuScalingActive = true;
+				}
+				else ofLog(OF_LOG_WARNING, "ofxMovieExporter: No framebuffer blit support, scaling on the CPU instead");
+			}
+		}
+		else if (sourceType == SOURCE_TEXTURE)
+		{
+			textureReader.bind();
+			activeReadbackFormat = readbackFormat == READBACK_AUTO ? chooseReadbackFormat(0, 0, inW, inH) : readbackFormat;
+			textureReader.unbind();
+			textureReader.allocate(getGlReadbackFormat(), getSourceFormat().strides[0]);
+		}
 
-		allocateMemory();
+		exporter.setup(getSourceFormat(), outW, outH, bitRate, frameRate, codecId, container);
 	}
 
 	ofxMovieExporter::~ofxMovieExporter()
 	{
-		if (recording) finishRecord();
-
-		stopThread();
-		clearMemory();
+		if (isRecording()) stop();
 	}
 
 	void ofxMovieExporter::record(string filePrefix, string folderPath)
 	{
-		initEncoder();
-
 		ostringstream oss;
 		oss << folderPath;
 		if (folderPath != "" && (folderPath[folderPath.size()-1] != '/' && folderPath[folderPath.size()-1] != '\\'))
             oss << "/";
-		oss << filePrefix << numCaptures << "." << container;
+		oss << filePrefix << numCaptures;
+		// image sequences number their files themselves
+		if (exporter.isAnimatedGif()) oss << ".gif";
+		else if (!exporter.isImageSequence()) oss << "." << container;
 		outFileName = oss.str();
+		startRecording(ofToDataPath(outFileName));
+	}
 
-		// open the output file
-		if (url_fopen(&formatCtx->pb, ofToDataPath(outFileName).c_str(), URL_WRONLY) < 0)
-			ofLog(OF_LOG_ERROR, "ofxMovieExporter: Could not open file %s", ofToDataPath(outFileName).c_str());
-
-		ofAddListener(ofEvents().draw, this, &ofxMovieExporter::checkFrame);
-
-		// write the stream header, if any
-		av_write_header(formatCtx);
-
-		lastFrameTime = 0;
-		frameNum = 0;
-		recording = true;
-#ifdef _THREAD_CAPTURE
-		startThread(true, false);
-#endif
+	void ofxMovieExporter::stream(string url)
+	{
+		// HLS playlists are files like any other recording
+		outFileName = HlsSegmenter::isPlaylistPath(url) ? ofToDataPath(url) : url;
+		startRecording(outFileName);
 	}
 
 	void ofxMovieExporter::stop()
 	{
+		// collect the frame still being read back
+		if (sourceType == SOURCE_TEXTURE && isRecording())
+		{
+			Frame* frame = exporter.getFrame();
+			if (textureReader.flush(frame->pixels)) exporter.addFrame(frame);
+			else frame->release();
+		}
 		ofRemoveListener(ofEvents().draw, this, &ofxMovieExporter::checkFrame);
-		recording = false;
+		exporter.stop();
 		numCaptures++;
-#ifndef _THREAD_CAPTURE
-		finishRecord();
-#endif
+	}
+
+	void ofxMovieExporter::setReadbackFormat(ReadbackFormat readbackFormat)
+	{
+		this->readbackFormat = readbackFormat;
+	}
+
+	void ofxMovieExporter::setGpuScaling(bool gpuScaling)
+	{
+		this->gpuScaling = gpuScaling;
 	}
 
 	void ofxMovieExporter::setRecordingArea(int x, int y, int w, int h)
@@ -173,28 +256,124 @@ namespace itg
 	}
 
 	void ofxMovieExporter::setPixelSource(unsigned char* pixels, int w, int h)
+	{
+		setPixelSource(FrameFormat(w, h), &pixels);
+	}
+
+	void ofxMovieExporter::setPixelSource(const FrameFormat& format, unsigned char* const planes[])
 	{
 		if (isRecording())
 			stop();
 			
-		if (pixels == NULL)
+		if (planes == NULL || planes[0] == NULL)
 		{
 			ofLog(OF_LOG_ERROR, "ofxMovieExporter: Could not set NULL pixel source");
 			return;
 		}
-		pixelSource = pixels;
-		inW = w;
-		inH = h;
-		usePixelSource = true;
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++)
+		{
+			pixelSource[i] = i < format.getNumPlanes() ? planes[i] : NULL;
+		}
+		sourceFormat = format;
+		inW = format.width;
+		inH = format.height;
+		// back to real time after a movie
+		if (sourceType == SOURCE_MOVIE) exporter.setOffline(false);
+		sourceType = SOURCE_PIXELS;
+		
+		// resetup encoder etc
+		setup(outW, outH, bitRate, frameRate, codecId, container);
+	}
+
+	void ofxMovieExporter::setDamageTracking(bool damageTracking)
+	{
+		this->damageTracking = damageTracking;
+		needsFullFrame = true;
+	}
+
+	void ofxMovieExporter::addDirtyRect(int x, int y, int w, int h)
+	{
+		dirtyRects.push_back(FrameRect(x, y, w, h));
+	}
+
+	void ofxMovieExporter::addDirtyRect(const ofRectangle& rect)
+	{
+		addDirtyRect(rect.x, rect.y, rect.width, rect.height);
+	}
+
+	void ofxMovieExporter::setTextureSource(ofFbo& fbo, int attachment)
+	{
+		setTextureSource(fbo.getTextureReference(attachment));
+	}
+
+	void ofxMovieExporter::setTextureSource(ofTexture& texture)
+	{
+		if (isRecording())
+			stop();
+		
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) pixelSource[i] = NULL;
+		textureReader.setup(texture);
+		inW = textureReader.getWidth();
+		inH = textureReader.getHeight();
+		// back to real time after a movie
+		if (sourceType == SOURCE_MOVIE) exporter.setOffline(false);
+		sourceType = SOURCE_TEXTURE;
+		
+		// resetup encoder etc
+		setup(outW, outH, bitRate, frameRate, codecId, container);
+	}
+
+	void ofxMovieExporter::setExternalSource(int w, int h)
+	{
+		setExternalSource(FrameFormat(w, h));
+	}
+
+	void ofxMovieExporter::setExternalSource(const FrameFormat& format)
+	{
+		if (isRecording())
+			stop();
+		
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) pixelSource[i] = NULL;
+		sourceFormat = format;
+		inW = format.width;
+		inH = format.height;
+		// back to real time after a movie
+		if (sourceType == SOURCE_MOVIE) exporter.setOffline(false);
+		sourceType = SOURCE_EXTERNAL;
+		
+		// resetup encoder etc
+		setup(outW, outH, bitRate, frameRate, codecId, container);
+	}
+
+	bool ofxMovieExporter::setMovieSource(string filePath)
+	{
+		if (isRecording())
+			stop();
+		
+		// waits for the last recording to be done with the previous movie's frames
+		if (!movieReader.open(ofToDataPath(filePath)))
+			return false;
+		
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) pixelSource[i] = NULL;
+		sourceFormat = movieReader.getFormat();
+		inW = sourceFormat.width;
+		inH = sourceFormat.height;
+		sourceType = SOURCE_MOVIE;
+		// the frames are decoded as fast as they're encoded
+		exporter.setOffline(true);
 		
 		// resetup encoder etc
 		setup(outW, outH, bitRate, frameRate, codecId, container);
+		return true;
 	}
 
 	void ofxMovieExporter::resetPixelSource()
 	{
-		usePixelSource = false;
-		pixelSource = NULL;
+		// back to real time after a movie
+		if (sourceType == SOURCE_MOVIE) exporter.setOffline(false);
+		sourceType = SOURCE_SCREEN;
+		for (int i = 0; i < FrameFormat::MAX_PLANES; i++) pixelSource[i] = NULL;
+		textureReader.clear();
 		inW = ofGetViewportWidth();
 		inH = ofGetViewportHeight();
 		
@@ -202,6 +381,52 @@ namespace itg
 		setup(outW, outH, bitRate, frameRate, codecId, container);
 	}
 		
+	void ofxMovieExporter::setupAudio(int sampleRate, int numChannels, CodecID codecId, int bitRate)
+	{
+		exporter.setupAudio(sampleRate, numChannels, codecId, bitRate);
+	}
+
+	void ofxMovieExporter::addAudio(float* samples, int bufferSize, int nChannels)
+	{
+		if (!exporter.hasAudio()) return;
+		if (nChannels != exporter.getNumAudioChannels())
+		{
+			ofLog(OF_LOG_ERROR, "ofxMovieExporter: Audio has %d channels, expected %d", nChannels, exporter.getNumAudioChannels());
+			return;
+		}
+		exporter.addAudioSamples(samples, bufferSize);
+	}
+
+	void ofxMovieExporter::audioIn(float* input, int bufferSize, int nChannels)
+	{
+		addAudio(input, bufferSize, nChannels);
+	}
+
+	bool ofxMovieExporter::isFrameDue()
+	{
+		return exporter.isFrameDue();
+	}
+
+	Frame* ofxMovieExporter::borrowFrame()
+	{
+		return exporter.getFrame();
+	}
+
+	void ofxMovieExporter::addFrame(Frame* frame)
+	{
+		exporter.addFrame(frame);
+	}
+
+	void ofxMovieExporter::addFrame(unsigned char* pixels, FrameReleaseCallback release, void* userData)
+	{
+		exporter.addFrame(pixels, release, userData);
+	}
+
+	void ofxMovieExporter::addFrame(unsigned char* const planes[], FrameReleaseCallback release, void* userData)
+	{
+		exporter.addFrame(planes, release, userData);
+	}
+
 	int ofxMovieExporter::getNumCaptures()
 	{
 		return numCaptures;
@@ -214,249 +439,174 @@ namespace itg
 		
 // PRIVATE
 
-	void ofxMovieExporter::finishRecord()
+	FrameFormat ofxMovieExporter::getSourceFormat()
 	{
-		av_write_trailer(formatCtx);
-
-		// free the encoder
-		avcodec_close(codecCtx);
-		for(int i = 0; i < formatCtx->nb_streams; i++)
+		if (sourceType == SOURCE_PIXELS || sourceType == SOURCE_EXTERNAL || sourceType == SOURCE_MOVIE) return sourceFormat;
+
+		// glReadPixels gives us the rows bottom first, each padded to GL_PACK_ALIGNMENT (4 by default)
+		// the blit already flips the image when scaling on the GPU
+		int w = gpuScalingActive ? outW : inW;
+		int h = gpuScalingActive ? outH : inH;
+		bool bottomUp = !gpuScalingActive;
+		switch (activeReadbackFormat)
 		{
-			av_freep(&formatCtx->streams[i]->codec);
-			av_freep(&formatCtx->streams[i]);
+			case READBACK_BGRA: return FrameFormat(w, h, PIX_FMT_BGRA, w * 4, bottomUp);
+			case READBACK_RGBA: return FrameFormat(w, h, PIX_FMT_RGBA, w * 4, bottomUp);
+			default: return FrameFormat(w, h, PIX_FMT_RGB24, (w * 3 + 3) & ~3, bottomUp);
 		}
-		av_free(formatCtx);
-		formatCtx = NULL;
-		//url_fclose(formatCtx->pb);
 	}
 
-#ifdef _THREAD_CAPTURE
-	void ofxMovieExporter::threadedFunction()
+	GLenum ofxMovieExporter::getGlReadbackFormat() const
 	{
-		while (isThreadRunning())
+		switch (activeReadbackFormat)
 		{
-			if (!frameQueue.empty())
-			{
-				float start = ofGetElapsedTimef();
-				frameQueueMutex.lock();
-				inPixels = frameQueue.front();
-				frameQueue.pop_front();
-				frameQueueMutex.unlock();
-
-				encodeFrame();
-
-				frameMemMutex.lock();
-				frameMem.push_back(inPixels);
-				frameMemMutex.unlock();
-				if (ofGetElapsedTimef() - start < frameInterval) ofSleepMillis(1000.f * (frameInterval - (ofGetElapsedTimef() - start)));
-			}
-			else if (!recording)
-			{
-				finishRecord();
-				stopThread();
-			}
+#ifdef GL_BGRA
+			case READBACK_BGRA: return GL_BGRA;
+#endif
+			case READBACK_RGBA: return GL_RGBA;
+			default: return GL_RGB;
 		}
 	}
-#endif
 
-	void ofxMovieExporter::checkFrame(ofEventArgs& args)
+	bool ofxMovieExporter::isBlitSupported()
 	{
-		if (ofGetElapsedTimef() - lastFrameTime >= frameInterval)
-		{
-#ifdef _THREAD_CAPTURE
-			unsigned char* pixels;
-			if (!frameMem.empty())
-			{
-				frameMemMutex.lock();
-				pixels = frameMem.back();
-				frameMem.pop_back();
-				frameMemMutex.unlock();
-			}
-			else
-			{
-				pixels = new unsigned char[inW * inH * 3];
-			}
-			
-			if (!usePixelSource)
-			{
-				// this part from ofImage::saveScreen
-				int screenHeight =	ofGetViewportHeight(); // if we are in a FBO or other viewport, this fails: ofGetHeight();
-				int screenY = screenHeight - posY;
-				screenY -= inH; // top, bottom issues
-				
-		 		glReadPixels(posX, screenY, inW, inH, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-			}
-			else
-			{
-				memcpy(pixels, pixelSource, inW * inH * 3);
-			}
-			
-			frameQueueMutex.lock();
-			frameQueue.push_back(pixels);
-			frameQueueMutex.unlock();
-#else
-			if (!usePixelSource) {
-				// this part from ofImage::saveScreen
-				int screenHeight =	ofGetViewportHeight(); // if we are in a FBO or other viewport, this fails: ofGetHeight();
-				int screenY = screenHeight - posY;
-				screenY -= inH; // top, bottom issues
-				
-				glReadPixels(posX, screenY, inW, inH, GL_RGB, GL_UNSIGNED_BYTE, inPixels);
-			}
-			else
-			{
-				memcpy(inPixels, pixelSource, inW * inH * 3);
-			}
-			encodeFrame();
-#endif
-			lastFrameTime = ofGetElapsedTimef();
-		}
+		const char* version = (const char*)glGetString(GL_VERSION);
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		if (version && version[0] >= '3' && version[0] <= '9') return true;
+		return extensions && strstr(extensions, "GL_EXT_framebuffer_blit");
 	}
 
-	void ofxMovieExporter::encodeFrame()
+	void ofxMovieExporter::readScreen(unsigned char* pixels)
 	{
-		
-		avpicture_fill((AVPicture*)inFrame, inPixels, PIX_FMT_RGB24, inW, inH);
-		avpicture_fill((AVPicture*)outFrame, outPixels, PIX_FMT_YUV420P, outW, outH);
+		// this part from ofImage::saveScreen
+		int screenHeight =	ofGetViewportHeight(); // if we are in a FBO or other viewport, this fails: ofGetHeight();
+		int screenY = screenHeight - posY;
+		screenY -= inH; // top, bottom issues
 
-		// intentionally flip the image to compensate for OF flipping if reading from the screen
-		if (!usePixelSource)
+		if (gpuScalingActive)
 		{
-			inFrame->data[0] += inFrame->linesize[0] * (inH - 1);
-			inFrame->linesize[0] = -inFrame->linesize[0];
-		}
-		
-		//perform the conversion for RGB to YUV and size
-		sws_scale(convertCtx, inFrame->data, inFrame->linesize, 0, inH, outFrame->data, outFrame->linesize);
+			GLint readFbo, drawFbo;
+			glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING_EXT, &readFbo);
+			glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING_EXT, &drawFbo);
+
+			// scale and flip in one go, the output comes back top row first
+			glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, scaleFbo.getFbo());
+			glBlitFramebufferEXT(posX, screenY, posX + inW, screenY + inH, 0, outH, outW, 0, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+			glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, scaleFbo.getFbo());
+			glReadPixels(0, 0, outW, outH, getGlReadbackFormat(), GL_UNSIGNED_BYTE, pixels);
 
-		int outSize = avcodec_encode_video(codecCtx, encodedBuf, ENCODED_FRAME_BUFFER_SIZE, outFrame);
-		if (outSize > 0)
+			glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, readFbo);
+			glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, drawFbo);
+		}
+		else
 		{
-			AVPacket pkt;
-			av_init_packet(&pkt);
-			//pkt.pts = av_rescale_q(codecCtx->coded_frame->pts, codecCtx->time_base, videoStream->time_base);
-			//if(codecCtx->coded_frame->key_frame) pkt.flags |= AV_PKT_FLAG_KEY;
-			pkt.pts = frameNum;//ofGetFrameNum();//codecCtx->coded_frame->pts;
-			pkt.flags |= AV_PKT_FLAG_KEY;
-			pkt.dts = pkt.pts;
-			pkt.stream_index = videoStream->index;
-			pkt.data = encodedBuf;
-			pkt.size = outSize;
-			av_write_frame(formatCtx, &pkt);
+			glReadPixels(posX, screenY, inW, inH, getGlReadbackFormat(), GL_UNSIGNED_BYTE, pixels);
 		}
-		frameNum++;
 	}
 
-	void ofxMovieExporter::allocateMemory()
+	ofxMovieExporter::ReadbackFormat ofxMovieExporter::chooseReadbackFormat(int x, int y, int w, int h)
 	{
-		// clear if we need to reallocate
-		if(inPixels)
-			clearMemory();
-		
-		// allocate input stuff
-#ifdef _THREAD_CAPTURE
-		//unsigned char* initFrameMem = new unsigned char[inW * inH * 3 * INIT_QUEUE_SIZE];
-		for (int i = 0; i < INIT_QUEUE_SIZE; i++)
+		static const int NUM_READS = 4;
+		ReadbackFormat candidates[] = { READBACK_RGB, READBACK_BGRA, READBACK_RGBA };
+		ReadbackFormat best = READBACK_RGB;
+		float bestTime = -1.f;
+		vector<unsigned char> pixels(w * h * 4);
+
+		for (int i = 0; i < 3; i++)
 		{
-			//frameMem.push_back(initFrameMem + inW * inH * 3 * i);
-			frameMem.push_back(new unsigned char[inW * inH * 3]);
-		}
-#else
-		inPixels = new unsigned char[inW * inH * 3];
+#ifndef GL_BGRA
+			if (candidates[i] == READBACK_BGRA) continue;
 #endif
-		inFrame = avcodec_alloc_frame();
+			activeReadbackFormat = candidates[i];
+			GLenum glFormat = getGlReadbackFormat();
+			while (glGetError() != GL_NO_ERROR);
 
-		// allocate output stuff
-		int outSize = avpicture_get_size(PIX_FMT_YUV420P, outW, outH);
-		outPixels = (unsigned char*)av_malloc(outSize);
-		outFrame = avcodec_alloc_frame();
+			// the first read can include one off driver set up
+			glReadPixels(x, y, w, h, glFormat, GL_UNSIGNED_BYTE, &pixels[0]);
+			glFinish();
 
-		encodedBuf = (unsigned char*)av_malloc(ENCODED_FRAME_BUFFER_SIZE);
-	}
+			float start = ofGetElapsedTimef();
+			for (int j = 0; j < NUM_READS; j++)
+			{
+				glReadPixels(x, y, w, h, glFormat, GL_UNSIGNED_BYTE, &pixels[0]);
+			}
+			glFinish();
+			float elapsed = ofGetElapsedTimef() - start;
 
-	void ofxMovieExporter::clearMemory() {
-		// clear input stuff
-#ifdef _THREAD_CAPTURE
-		for (int i = 0; i < frameMem.size(); i++)
-		{
-			delete[] frameMem[i];
+			if (glGetError() == GL_NO_ERROR && (bestTime < 0.f || elapsed < bestTime))
+			{
+				best = candidates[i];
+				bestTime = elapsed;
+			}
 		}
-		for (int i = 0; i < frameQueue.size(); i++)
+		ofLog(OF_LOG_VERBOSE, "ofxMovieExporter: Reading back pixels as %s", best == READBACK_BGRA ? "BGRA" : best == READBACK_RGBA ? "RGBA" : "RGB");
+		return best;
+	}
+
+	void ofxMovieExporter::startRecording(const string& path)
+	{
+		needsFullFrame = true;
+		dirtyRects.clear();
+		if (exporter.record(path) && sourceType != SOURCE_EXTERNAL)
 		{
-			delete[] frameQueue[i];
+			ofAddListener(ofEvents().draw, this, &ofxMovieExporter::checkFrame);
 		}
-#else
-		delete[] inPixels;
-#endif
-		inPixels = NULL;
-		
-		av_free(inFrame);
-		av_free(outFrame);
-		av_free(encodedBuf);
-		av_free(outPixels);
-
-		inFrame = NULL;
-		outFrame = NULL;
-		encodedBuf = NULL;
-		outPixels = NULL;
 	}
 
-	void ofxMovieExporter::initEncoder()
+	void ofxMovieExporter::checkFrame(ofEventArgs& args)
 	{
-		/////////////////////////////////////////////////////////////
-		// find codec
-		codec = avcodec_find_encoder(codecId);
-		if (!codec) ofLog(OF_LOG_ERROR, "ofxMovieExporter: Codec not found");
-
-		////////////////////////////////////////////////////////////
-		// auto detect the output format from the name. default is mpeg.
-		ostringstream oss;
-		oss << "amovie." << container;
-		outputFormat = av_guess_format(NULL, oss.str().c_str(), NULL);
-		if (!outputFormat) ofLog(OF_LOG_ERROR, "ofxMovieExporter: Could not guess output container for an %s file (ueuur!!)", container.c_str());
-		// set the format codec (the format also has a default codec that can be read from it)
-		outputFormat->video_codec = codec->id;
-
-		/////////////////////////////////////////////////////////////
-		// allocate the format context
-		formatCtx = avformat_alloc_context();
-		if (!formatCtx) ofLog(OF_LOG_ERROR, "ofxMovieExporter: Could not allocate format context");
-		formatCtx->oformat = outputFormat;
-
-		/////////////////////////////////////////////////////////////
-		// set up the video stream
-		videoStream = av_new_stream(formatCtx, 0);
-
-		/////////////////////////////////////////////////////////////
-		// init codec context
-		codecCtx = videoStream->codec;
-		codecCtx->bit_rate = bitRate;
-		codecCtx->width = outW;
-		codecCtx->height = outH;
-
-		codecCtx->time_base.num = 1;//codecCtx->ticks_per_frame;
-		codecCtx->time_base.den = frameRate;
-		videoStream->time_base = codecCtx->time_base;
-
-
-		codecCtx->gop_size = 10; /* emit one intra frame every ten frames */
-		codecCtx->pix_fmt = PIX_FMT_YUV420P;
-
-		if (codecCtx->codec_id == CODEC_ID_MPEG1VIDEO)
+		if (sourceType == SOURCE_MOVIE)
 		{
-			/* needed to avoid using macroblocks in which some coeffs overflow
-			 this doesnt happen with normal video, it just happens here as the
-			 motion of the chroma plane doesnt match the luma plane */
-			codecCtx->mb_decision=2;
+			// not paced by the frame rate, the reader's bounded queue keeps the decoder
+			// from getting too far ahead of the encoder
+			while (Frame* frame = movieReader.readFrame(false)) exporter.addFrame(frame);
+			if (movieReader.isFinished()) stop();
+			return;
 		}
-		// some formats want stream headers to be seperate
-		if(!strcmp(formatCtx->oformat->name, "mp4") || !strcmp(formatCtx->oformat->name, "mov") || !strcmp(formatCtx->oformat->name, "3gp"))
-			codecCtx->flags |= CODEC_FLAG_GLOBAL_HEADER;
-
-		// set the output parameters (must be done even if no parameters).
-		if (av_set_parameters(formatCtx, NULL) < 0)	ofLog(OF_LOG_ERROR, "ofxMovieExproter: Could not set format parameters");
 
-		// open codec
-		if (avcodec_open(codecCtx, codec) < 0) ofLog(OF_LOG_ERROR, "ofxMovieExproter: Could not open codec");
+		if (exporter.isFrameDue())
+		{
+			Frame* frame = exporter.getFrame();
+			unsigned char* pixels = frame->pixels;
+			
+			if (sourceType == SOURCE_SCREEN)
+			{
+				readScreen(pixels);
+			}
+			else if (sourceType == SOURCE_TEXTURE)
+			{
+				// nothing to hand over yet on the first read
+				if (!textureReader.read(pixels))
+				{
+					frame->release();
+					return;
+				}
+			}
+			else if (damageTracking && !needsFullFrame && exporter.canConvertPartialFrames())
+			{
+				// only the changed bands are copied, the encoder thread only converts those
+				frame->setUnchanged();
+				for (unsigned i = 0; i < dirtyRects.size(); i++) frame->addDirtyRect(dirtyRects[i]);
+				frame->getDirtyBands(sourceFormat.height, dirtyBands);
+				for (unsigned i = 0; i < dirtyBands.size(); i++)
+				{
+					if (!dirtyBands[i]) continue;
+					int y = i * Frame::DIRTY_BAND_HEIGHT;
+					sourceFormat.copyRows(pixelSource, frame->planes, y, min(Frame::DIRTY_BAND_HEIGHT, sourceFormat.height - y));
+				}
+			}
+			else
+			{
+				for (int i = 0; i < sourceFormat.getNumPlanes(); i++)
+				{
+					memcpy(frame->planes[i], pixelSource[i], sourceFormat.getPlaneSize(i));
+				}
+			}
+			dirtyRects.clear();
+			needsFullFrame = false;
+			
+			exporter.addFrame(frame);
+		}
 	}
 }
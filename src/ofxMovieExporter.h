@@ -31,41 +31,35 @@
  */
 #pragma once
 
-#define _THREAD_CAPTURE
-
 #include "ofMain.h"
-
-// needed for gcc on win
-#ifdef TARGET_WIN32
-    #ifndef INT64_C
-        #define INT64_C(c) (c ## LL)
-        #define UINT64_C(c) (c ## ULL)
-    #endif
-#endif
-
-extern "C"
-{
-    #include <avcodec.h>
-    #include <avformat.h>
-    #include <swscale.h>
-	#include <mathematics.h>
-}
+#include "MovieExporter.h"
+#include "MovieReader.h"
+#include "ofxTextureReader.h"
 
 namespace itg
 {
-	class ofxMovieExporter
-#ifdef _THREAD_CAPTURE
-		: public ofThread
-#endif
+	class ofxMovieExporter : public ofBaseSoundInput
 	{
 	public:
-		static const int ENCODED_FRAME_BUFFER_SIZE = 500000;
+		// pixel layout requested from glReadPixels when recording the screen
+		enum ReadbackFormat
+		{
+			// time the others on the current context in setup() and use the fastest
+			READBACK_AUTO,
+			READBACK_RGB,
+			// 4 bytes per pixel, rows are always aligned and most drivers
+			// can copy their native BGRA framebuffer without swizzling
+			READBACK_BGRA,
+			READBACK_RGBA
+		};
+
+		static const int ENCODED_FRAME_BUFFER_SIZE = VideoEncoder::ENCODED_FRAME_BUFFER_SIZE;
 		// defaults
 		static const int BIT_RATE = 4000000;
 		static const int FRAME_RATE = 25;
 		static const int OUT_W = 640;
 		static const int OUT_H = 480;
-		static const int INIT_QUEUE_SIZE = 50;
+		static const int INIT_QUEUE_SIZE = MovieExporter::INIT_QUEUE_SIZE;
 		static const CodecID CODEC_ID = CODEC_ID_MPEG4;
 		static const string FILENAME_PREFIX;
 		static const string CONTAINER;
@@ -77,9 +71,24 @@ namespace itg
 		// codecId = CODEC_ID_MPEG2VIDEO, container = "mov"
 		void setup(int outW = OUT_W, int outH = OUT_H, int bitRate = BIT_RATE, int frameRate = FRAME_RATE, CodecID codecId = CODEC_ID, string container = CONTAINER);
 		void record(string filePrefix=FILENAME_PREFIX, string folderPath="");
+		// push to a URL instead of saving a file, udp://127.0.0.1:1234 with an "mpegts"
+		// container or rtmp://server/app/name with "flv", stop() ends the stream.  A .m3u8
+		// path, relative to the data folder, writes an HLS playlist and segments instead
+		void stream(string url);
 		void stop();
 		bool isRecording() const;
 
+        // how to read pixels back from the screen, call before setup(), default: READBACK_AUTO
+        void setReadbackFormat(ReadbackFormat readbackFormat);
+        // the format actually in use, never READBACK_AUTO once setup() has been called
+        inline ReadbackFormat getReadbackFormat() const {return activeReadbackFormat;}
+
+        // when the output is smaller than the recording area, scale it down on the GPU by
+        // blitting into an output sized FBO (linear filtering) and only read that back,
+        // needs framebuffer blit support, call before setup(), default: false
+        void setGpuScaling(bool gpuScaling);
+        inline bool isGpuScaling() const {return gpuScalingActive;}
+
         // set the recording area
         // x, y is the upper left corner of the recording area, default: 0, 0
         // w x h is the area size, default: viewport width x height
@@ -96,10 +105,137 @@ namespace itg
 		// also sets the recording size but does not crop to the recording area
 		void setPixelSource(unsigned char* pixels, int w, int h);
 		
+		// same for any layout swscale can read, e.g. padded BGRA rows, GRAY8 or NV12
+		// planes holds one pointer per plane of the format, they are read every frame
+		void setPixelSource(const FrameFormat& format, unsigned char* const planes[]);
+		
+		// record an attachment of an FBO or any texture, read back asynchronously through pixel buffer
+		// objects, so it doesn't depend on the viewport or have to be drawn to the screen
+		// also sets the recording size to the texture size, frames arrive one draw late
+		void setTextureSource(ofFbo& fbo, int attachment = 0);
+		void setTextureSource(ofTexture& texture);
+		
+		// frames will be handed over by the app with addFrame() rather than grabbed
+		// every draw, w x h 3 Byte RGB, doesn't crop to the recording area
+		void setExternalSource(int w, int h);
+		void setExternalSource(const FrameFormat& format);
+		
+		// transcode a movie, relative to the data folder, instead of recording the screen.  Its
+		// frames are decoded in the background and added as fast as the encoder takes them,
+		// in the decoder's YUV, and the recording stops itself at the end of the file.  Sets the
+		// recording size to the movie's, each record() carries on where the last one stopped
+		// and the movie's sound isn't included
+		bool setMovieSource(string filePath);
+		
 		// reset the pixel source and record from the screen
 		// also resets the recording size to the viewport width
 		void resetPixelSource();
 		
+		// pixel source only, with damage tracking on only the rects passed to addDirtyRect()
+		// since the last capture are copied and converted, if none were added the frame
+		// is taken to be unchanged.  Needs the recording size to match the source
+		void setDamageTracking(bool damageTracking);
+		inline bool isDamageTracking() const {return damageTracking;}
+		void addDirtyRect(int x, int y, int w, int h);
+		void addDirtyRect(const ofRectangle& rect);
+		
+		// external source only, true if it's time for the next frame
+		bool isFrameDue();
+		
+		// external source only, borrow an exporter buffer to render into and pass it back
+		// with addFrame(Frame*), nothing is copied on the way to the encoder
+		Frame* borrowFrame();
+		void addFrame(Frame* frame);
+		
+		// external source only, hand over a buffer without copying it, release is called
+		// from the encoder thread once it has been encoded so don't touch pixels before then
+		void addFrame(unsigned char* pixels, FrameReleaseCallback release, void* userData = NULL);
+		void addFrame(unsigned char* const planes[], FrameReleaseCallback release, void* userData = NULL);
+		
+		// record sound too, call before setup(), then either pass the exporter to an
+		// ofSoundStream as its input or forward samples with addAudio() from audioIn()/audioOut()
+		void setupAudio(int sampleRate = 44100, int numChannels = 2, CodecID codecId = CODEC_ID_AAC, int bitRate = MovieExporter::AUDIO_BIT_RATE);
+		void addAudio(float* samples, int bufferSize, int nChannels);
+		void audioIn(float* input, int bufferSize, int nChannels);
+		
+		// don't convert or encode frames that are identical to the previous one, for mostly
+		// static content, the last frame is held on screen for longer instead
+		inline void setSkipDuplicateFrames(bool skip) {exporter.setSkipDuplicateFrames(skip);}
+		inline int getNumFramesSkipped() const {return exporter.getNumFramesSkipped();}
+		
+		// also write a smaller copy of each recording, from the same readback, scaled down
+		// from the master's YUV and saved as <prefix><n><fileSuffix>.<container>
+		inline void addRendition(int outW, int outH, int bitRate, const string& fileSuffix, CodecID codecId = CODEC_ID, const string& container = CONTAINER) {exporter.addRendition(outW, outH, bitRate, codecId, container, fileSuffix);}
+		inline void clearRenditions() {exporter.clearRenditions();}
+		
+		// save every frame as a numbered image, <prefix><n>_00000.png and so on, instead of
+		// a movie.  Images are compressed by a pool of numWorkers threads (0 for one per
+		// core), compression is the zlib level 0-9 for PNG and TIFF or quality 1-100 for JPEG
+		inline void setImageSequence(ImageFormat format = IMAGE_PNG, int compression = -1, int numWorkers = 0) {exporter.setImageSequence(format, compression, numWorkers);}
+		inline void disableImageSequence() {exporter.disableImageSequence();}
+		
+		// record a looping animated GIF, <prefix><n>.gif, instead of a movie.  Frames are
+		// kept on disk rather than in memory and the GIF is written after stop(), palette,
+		// dithering and compression are shared between numWorkers threads (0 for one per core)
+		inline void setAnimatedGif(bool dither = true, int numWorkers = 0) {exporter.setAnimatedGif(dither, numWorkers);}
+		inline void disableAnimatedGif() {exporter.disableAnimatedGif();}
+		
+		// stop() returns straight away and the file is finished in the background, so the next
+		// record() can follow immediately.  finished(filePath, succeeded, userData) is called
+		// from the encoder thread once each file is closed
+		inline void setFinishedCallback(RecordingFinishedCallback finished, void* userData = NULL) {exporter.setFinishedCallback(finished, userData);}
+		
+		// open the encoder in the background after setup() and after each stop() so that
+		// record() doesn't stall the frame it's called in
+		inline void setWarmStandby(bool warmStandby) {exporter.setWarmStandby(warmStandby);}
+		
+		// give up scaler quality, motion search and finally frame rate when the encoder
+		// can't keep up, rather than queueing frames without limit, call before record()
+		inline void setAdaptiveQuality(bool adaptiveQuality) {exporter.setAdaptiveQuality(adaptiveQuality);}
+		inline QualityGovernor::Level getQualityLevel() const {return exporter.getQualityLevel();}
+		
+		// encoder and muxer settings for stream(), every frame is sent as soon as it's encoded
+		inline void setLowLatency(bool lowLatency) {exporter.setLowLatency(lowLatency);}
+		// average seconds from capturing a frame to sending its packet
+		inline float getStreamLatency() const {return exporter.getStreamLatency();}
+		inline int getNumPacketsDropped() const {return exporter.getNumPacketsDropped();}
+		
+		// for renders that don't run in real time, frames are encoded as fast as they're added.
+		// On while the movie source is set
+		inline void setOffline(bool offline) {exporter.setOffline(offline);}
+		inline bool getOffline() const {return exporter.getOffline();}
+		
+		// put keyframes on cuts in what's recorded and make the regular GOP much longer,
+		// smaller files at the same quality and seek points on shot boundaries
+		inline void setSceneDetection(bool sceneDetection) {exporter.setSceneDetection(sceneDetection);}
+		
+		// while recording a movie, make the next frame captured a keyframe so it can be
+		// seeked to straight away, and with addChapter() also start a named chapter there
+		inline void markKeyframe() {exporter.markKeyframe();}
+		inline void addChapter(const string& name) {exporter.addChapter(name);}
+		
+		// encode each recording twice, a quick analysis while recording and the real thing
+		// after stop(), to hit the bit rate or targetFileSize (bytes) closely.  Frames are
+		// kept on disk in between, the file is finished once the second pass is done
+		inline void setTwoPass(bool twoPass, int64_t targetFileSize = 0) {exporter.setTwoPass(twoPass, targetFileSize);}
+		
+		// offline renders only: encode chunks of the movie on numWorkers threads (0 for one
+		// per core) and join them into one file, addFrame() waits for the workers once
+		// enough frames are queued.  Not for streams, renditions or audio
+		inline void setChunkedEncoding(bool chunked, int numWorkers = 0, int chunkFrames = 0) {exporter.setChunkedEncoding(chunked, numWorkers, chunkFrames);}
+		
+		// keep one of every stride frames, or the average of them with accumulate, for
+		// time-lapses played back at the frame rate from setup().  Frames are counted rather
+		// than timed, so capture runs every frame (or every stride'th) while it's on
+		inline void setTimeLapse(int stride, bool accumulate = true) {exporter.setTimeLapse(stride, accumulate);}
+		
+		// motion blur for offline renders: every draw is captured as a sub-frame and each
+		// subFrames of them are averaged into one frame in the background.  Animate to
+		// getSubFrameTime() rather than the real time.  With supersample the recording area
+		// is that many times the movie's size and is box filtered down while averaging
+		inline void setMotionBlur(int subFrames, int supersample = 1) {exporter.setMotionBlur(subFrames, supersample);}
+		inline float getSubFrameTime() const {return exporter.getSubFrameTime();}
+		
 		// get the number files that have been captured so far
 		int getNumCaptures();
 		
@@ -110,59 +246,63 @@ namespace itg
 		inline int getRecordingWidth() 	{return outW;}
 		inline int getRecordingHeight() {return outH;}
 
+		// the openFrameworks free encoder underneath
+		inline MovieExporter& getExporter() {return exporter;}
+
 	private:
-#ifdef _THREAD_CAPTURE
-		void threadedFunction();
-		deque<unsigned char*> frameQueue;
-		deque<unsigned char*> frameMem;
-		ofMutex frameQueueMutex;
-		ofMutex frameMemMutex;
-#endif
-		void initEncoder();
-		void allocateMemory();
-		void clearMemory();
+		enum SourceType
+		{
+			SOURCE_SCREEN,
+			SOURCE_PIXELS,
+			SOURCE_TEXTURE,
+			SOURCE_EXTERNAL,
+			SOURCE_MOVIE
+		};
 
+		void startRecording(const string& path);
 		void checkFrame(ofEventArgs& args);
-		void encodeFrame();
-		void finishRecord();
+		FrameFormat getSourceFormat();
+		ReadbackFormat chooseReadbackFormat(int x, int y, int w, int h);
+		GLenum getGlReadbackFormat() const;
+		bool isBlitSupported();
+		void readScreen(unsigned char* pixels);
+
+		MovieExporter exporter;
+		// declared after the exporter so it's closed while the exporter can still release its frames
+		MovieReader movieReader;
 
 		string container;
 		CodecID codecId;
 
-		bool recording;
 		int numCaptures;
 		int frameRate;
 		int bitRate;
-		float frameInterval;
-		float lastFrameTime;
-		int frameNum;
 		string outFileName;
 
-		AVOutputFormat* outputFormat;
-		AVFormatContext* formatCtx;
-		AVStream* videoStream;
-
-		AVCodec* codec;
-		AVCodecContext* codecCtx;
-
-		SwsContext* convertCtx;
-
-		unsigned char* inPixels;
-		unsigned char* outPixels;
-		unsigned char* encodedBuf;
-
-		AVFrame* inFrame;
-		AVFrame* outFrame;
-
 		int posX, posY;
 		int inW, inH;
 		int outW, outH;
 		
-		bool usePixelSource;
-		unsigned char* pixelSource;
+		ReadbackFormat readbackFormat;
+		ReadbackFormat activeReadbackFormat;
+
+		bool gpuScaling;
+		bool gpuScalingActive;
+		ofFbo scaleFbo;
+		ofxTextureReader textureReader;
+
+		bool damageTracking;
+		// the first capture of a recording always copies the whole source
+		bool needsFullFrame;
+		vector<FrameRect> dirtyRects;
+		vector<unsigned char> dirtyBands;
+
+		SourceType sourceType;
+		FrameFormat sourceFormat;
+		unsigned char* pixelSource[FrameFormat::MAX_PLANES];
 	};
 
-	inline bool ofxMovieExporter::isRecording() const { return recording; }
+	inline bool ofxMovieExporter::isRecording() const { return exporter.isRecording(); }
 }
 
 namespace Apex = itg;
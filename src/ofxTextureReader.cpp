@@ -0,0 +1,168 @@
+/*
+ *  ofxTextureReader.cpp
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "ofxTextureReader.h"
+
+namespace itg
+{
+	ofxTextureReader::ofxTextureReader() :
+		fbo(0), pboIndex(0), usePbos(false), format(GL_RGB), stride(0), width(0), height(0), prevReadFbo(0)
+	{
+		for (int i = 0; i < NUM_PBOS; i++)
+		{
+			pbos[i] = 0;
+			pending[i] = false;
+		}
+	}
+
+	ofxTextureReader::~ofxTextureReader()
+	{
+		clear();
+	}
+
+	void ofxTextureReader::setup(ofTexture& texture)
+	{
+		clear();
+		width = texture.getWidth();
+		height = texture.getHeight();
+
+		GLint prevFbo;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &prevFbo);
+		glGenFramebuffersEXT(1, &fbo);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, texture.getTextureData().textureTarget, texture.getTextureData().textureID, 0);
+		if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+		{
+			ofLog(OF_LOG_ERROR, "ofxMovieExporter: Could not attach texture for reading");
+		}
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, prevFbo);
+	}
+
+	void ofxTextureReader::allocate(GLenum format, int stride)
+	{
+		this->format = format;
+		this->stride = stride;
+
+		if (usePbos) glDeleteBuffers(NUM_PBOS, pbos);
+		usePbos = isPboSupported();
+		if (usePbos)
+		{
+			glGenBuffers(NUM_PBOS, pbos);
+			for (int i = 0; i < NUM_PBOS; i++)
+			{
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+				glBufferData(GL_PIXEL_PACK_BUFFER, stride * height, NULL, GL_STREAM_READ);
+				pending[i] = false;
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		pboIndex = 0;
+	}
+
+	void ofxTextureReader::clear()
+	{
+		if (usePbos) glDeleteBuffers(NUM_PBOS, pbos);
+		if (fbo) glDeleteFramebuffersEXT(1, &fbo);
+		for (int i = 0; i < NUM_PBOS; i++)
+		{
+			pbos[i] = 0;
+			pending[i] = false;
+		}
+		fbo = 0;
+		usePbos = false;
+	}
+
+	void ofxTextureReader::bind()
+	{
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING_EXT, &prevReadFbo);
+		glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	}
+
+	void ofxTextureReader::unbind()
+	{
+		glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, prevReadFbo);
+	}
+
+	bool ofxTextureReader::read(unsigned char* pixels)
+	{
+		bind();
+		if (!usePbos)
+		{
+			glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+			unbind();
+			return true;
+		}
+
+		// kick off this frame's read, it lands in the PBO without blocking
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[pboIndex]);
+		glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pending[pboIndex] = true;
+		unbind();
+
+		// and collect the one started last time, which should have finished by now
+		pboIndex = (pboIndex + 1) % NUM_PBOS;
+		if (!pending[pboIndex]) return false;
+		copyOut(pboIndex, pixels);
+		return true;
+	}
+
+	bool ofxTextureReader::flush(unsigned char* pixels)
+	{
+		// the newest read is the one before pboIndex
+		int index = (pboIndex + NUM_PBOS - 1) % NUM_PBOS;
+		if (!usePbos || !pending[index]) return false;
+		copyOut(index, pixels);
+		return true;
+	}
+
+	void ofxTextureReader::copyOut(int index, unsigned char* pixels)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[index]);
+		unsigned char* mapped = (unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (mapped)
+		{
+			memcpy(pixels, mapped, stride * height);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pending[index] = false;
+	}
+
+	bool ofxTextureReader::isPboSupported()
+	{
+		const char* version = (const char*)glGetString(GL_VERSION);
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		if (version && (version[0] > '2' || (version[0] == '2' && version[2] >= '1')) && version[0] <= '9') return true;
+		return extensions && strstr(extensions, "GL_ARB_pixel_buffer_object");
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ *  ofxTextureReader.h
+ *
+ *  Copyright (c) 2011, Neil Mendoza, http://www.neilmendoza.com
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of 16b.it nor the names of its contributors may be used
+ *    to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+
+#include "ofMain.h"
+
+namespace itg
+{
+	// reads a texture back without stalling on it, glReadPixels goes into one of a pair of
+	// pixel buffer objects and the other one, filled last time, is mapped and copied out
+	class ofxTextureReader
+	{
+	public:
+		static const int NUM_PBOS = 2;
+
+		ofxTextureReader();
+		~ofxTextureReader();
+
+		// attaches the texture to a framebuffer of our own so the viewport, current FBO and
+		// multisampling of whatever drew into it don't matter
+		void setup(ofTexture& texture);
+		// format is passed to glReadPixels, stride is the bytes per row it will give us
+		void allocate(GLenum format, int stride);
+		void clear();
+
+		// bind the texture for reading with glReadPixels, restores the previous binding on unbind()
+		void bind();
+		void unbind();
+
+		// start reading the current contents, fills pixels with what was started last time and
+		// returns true or returns false if this is the first read, without PBOs it just reads now
+		bool read(unsigned char* pixels);
+		// get the read that is still in flight, returns false if there isn't one
+		bool flush(unsigned char* pixels);
+
+		inline int getWidth() const { return width; }
+		inline int getHeight() const { return height; }
+
+	private:
+		static bool isPboSupported();
+		void copyOut(int index, unsigned char* pixels);
+
+		GLuint fbo;
+		GLuint pbos[NUM_PBOS];
+		bool pending[NUM_PBOS];
+		int pboIndex;
+		bool usePbos;
+		GLenum format;
+		int stride;
+		int width, height;
+		GLint prevReadFbo;
+	};
+}